@@ -0,0 +1,83 @@
+#pragma once
+
+// CPU-side passes of a frame, see FrameStats::cpuTimes
+enum FramePass : uint8_t
+{
+    // Hot reloading, moving render entities between lists and updating hierarchies
+    FramePass_Update = 0,
+    // Gathering the visible render entities into the frame
+    FramePass_Snapshot,
+    // Turning the render entities into draw packets
+    FramePass_Queue,
+    // Sorting the draw packets by state and depth
+    FramePass_Sort,
+    // Sending the draws to the backend and finishing the frame
+    FramePass_Submit,
+
+    FramePass_MAX
+};
+
+// Timings and counters of one frame, see IRenderWorld::GetFrameStats
+struct FrameStats
+{
+    // How many frames IRenderWorld::GetFrameStats can go back
+    static constexpr uint32_t HistorySize = 128U;
+
+    // Counts up from 0 with every frame drawn
+    uint64_t    frameNumber{ 0U };
+    // Milliseconds the CPU spent on each pass. Update and Snapshot run on the
+    // thread that calls RenderFrame, the rest on the render thread, if there is one
+    float       cpuTimes[FramePass_MAX]{};
+    // Milliseconds the GPU spent on the frame, below 0 until it's known
+    // The GPU is behind the CPU, so this comes in a few frames later
+    float       gpuTime{ -1.0f };
+
+    // Render entities in the frame, immediate ones included, and the surfaces queued for them
+    // A render batch is one surface, however many instances it has
+    uint32_t    numEntities{ 0U };
+    uint32_t    numSurfaces{ 0U };
+
+    uint32_t    numDrawCalls{ 0U };
+    uint32_t    numTriangles{ 0U };
+    // State changes that went to the driver, and the redundant ones that didn't
+    uint32_t    numStateChanges{ 0U };
+    uint32_t    numSkippedStateChanges{ 0U };
+    // Everything written into GPU buffers: batch updates, transient instances,
+    // indirect commands and view uniforms. Models and textures aren't counted
+    uint32_t    numUploadedBytes{ 0U };
+    // Batch data that wasn't uploaded, because only the changed ranges were
+    uint32_t    numBatchBytesSaved{ 0U };
+    // How many times the CPU had to wait for the GPU to be done with the stream buffer
+    uint32_t    numStreamBufferStalls{ 0U };
+
+    // @returns All of cpuTimes added up
+    float       GetCpuTime() const
+    {
+        float total = 0.0f;
+        for ( const float& time : cpuTimes )
+        {
+            total += time;
+        }
+
+        return total;
+    }
+};
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -92,6 +92,10 @@ enum ShaderFlags
     ShaderFlag_Instanced = 1 << 1,
     // ShaderFlag_Normal + can be used with skinned animated models
     ShaderFlag_CanSkin = 1 << 2,
+    // ShaderFlag_Normal + per-draw data comes from a storage buffer, for multi-draw indirect
+    ShaderFlag_Indirect = 1 << 3,
+    // ShaderFlag_Instanced + instances are RenderBatchCompactParams instead of matrices
+    ShaderFlag_CompactInstanced = 1 << 4,
 
     ShaderFlag_MAX = 1 << 15
 };
@@ -111,14 +115,27 @@ public:
     virtual bool Compile() = 0;
     
     // Reloads the shader
-    virtual void Reload() = 0;
+    // @returns false if it can't be loaded anymore, it keeps working as before then, see GetErrorMessage
+    virtual bool Reload() = 0;
     
     // Binds the shader to be used for rendering
     virtual void Bind( uint16_t shaderFlags ) = 0;
+
+    // @returns Whether the permutation for these flags is done compiling and can be bound
+    // Shaders compile in the background, use a fallback shader until this is true
+    virtual bool IsReady( uint16_t shaderFlags ) = 0;
+
+    // @returns Whether this shader has a permutation for all of the given flags
+    virtual bool SupportsFlags( uint16_t shaderFlags ) const = 0;
     
     // @returns The error message, in case there was one while compiling
     virtual const char* GetErrorMessage() const = 0;
 
+    // @returns How many files the shader is made of, the shader file and everything it includes
+    virtual uint32_t GetNumDependencies() const = 0;
+    // @returns The absolute path to one of them
+    virtual const char* GetDependency( uint32_t index ) const = 0;
+
     /*
     // Ideas for instanced rendering & skinned rendering 
 
@@ -136,6 +153,8 @@ public:
     virtual void BindSkinned() = 0;
     */
 
+    // @returns A handle to the uniform, the same in every shader and permutation
+    // It doesn't ask the driver, so it can be looked up once and kept around
     virtual uint32_t GetUniformHandle( const char* uniformName ) const = 0;
     virtual void SetUniform1i( const uint32_t& uniformHandle, const int& value ) = 0;
     virtual void SetUniform1f( const uint32_t& uniformHandle, const float& value ) = 0;
@@ -4,6 +4,7 @@
 #include <array>
 #include <vector>
 #include <string>
+#include <functional>
 
 #ifndef byte
 using byte = uint8_t;
@@ -23,6 +24,9 @@ constexpr   RenderEntityHandle RenderHandleInvalid = ~0;
 using       BatchHandle = uint16_t;
 constexpr   BatchHandle BatchInvalid = ~0U;
 
+// Render masks are ints, each bit is a separate render layer
+constexpr   uint32_t RenderMaskBits = sizeof( int ) * 8U;
+
 // Batch size of 1 -> non-instanced rendering
 // Batch size of 2 and higher -> instanced rendering
 constexpr   uint32_t BatchSizeThreshold = 1U;
@@ -34,6 +38,7 @@ constexpr   uint32_t BatchSizeThreshold = 1U;
 #include "RenderEntityParams.hpp"
 #include "RenderModelParams.hpp"
 #include "RenderView.hpp"
+#include "FrameStats.hpp"
 
 // (things that are exposed to the end user are marked with [E])
 // It is important to differentiate several concepts:
@@ -48,8 +53,8 @@ constexpr   uint32_t BatchSizeThreshold = 1U;
 // -----------------------
 // Render batch            -> an object in the render backend that allows the end user to render thousands 
 //                            of instances of the same render entity, which helps with performance
-// Render batch params[E]  -> render data for each instance in the batch, located in render entity params
-// Render batch handle     -> a handle to a render batch, which is actually an internal thing between the frontend & backend
+// Render batch params[E]  -> render data for each instance in the batch, copied into the render batch
+// Render batch handle[E]  -> a handle to a render batch, assigned to render entity params to draw them instanced
 // -----------------------
 // Also, on the higher level:
 // -----------------------
@@ -90,6 +95,52 @@ struct RenderInitParams
     int renderBackend{ Renderer_OpenGL45 };
     int windowingFramework{ Windowing_SDL2 };
     void* context{ nullptr }; // e.g. SDL2 OpenGL context
+
+    // Visible entities that share a model surface and material are drawn
+    // with a single instanced draw call, if there are at least this many
+    // of them. 0 turns automatic instancing off
+    uint32_t autoInstancingThreshold{ 4U };
+
+    // Unbatched entities are drawn with multi-draw indirect, one call
+    // per shader & material, if the backend and the shader support it
+    bool useIndirectDrawing{ true };
+
+    // Linked shader programs are kept in this directory, so they don't have to be
+    // compiled again on the next start. nullptr turns the program cache off
+    const char* shaderCacheDirectory{ "shadercache" };
+    // Shader permutations are compiled the first time they're drawn with, and the ones
+    // that were are written into <shader>.usage, to be compiled right away on the next start
+    // Turn this off once the usage lists are complete, or if the shader directory is read-only
+    bool recordShaderUsage{ true };
+
+    // Watches the files of shaders, textures and models, and reloads whatever uses the ones that
+    // changed, without stopping the game. Shaders are also reloaded when a file they #include changes
+    // Textures and models are read on other threads, and everything is swapped in at the start of a frame
+    bool hotReload{ false };
+
+    // Has the driver report GL errors and warnings through KHR_debug as they happen
+    // On by default in debug builds, where it also makes the reports synchronous, so the call
+    // stack points at the offending GL call. Pair it with a debug context for the full picture
+#ifdef NDEBUG
+    bool debugOutput{ false };
+#else
+    bool debugOutput{ true };
+#endif
+
+    // Worker threads that help build the render queue every frame
+    // Below 0 picks one less than the number of CPU cores, 0 keeps it all on the calling thread
+    int numWorkerThreads{ -1 };
+
+    // Draws on a render thread of its own, which the context is moved to. RenderFrame then
+    // only hands the visible entities over, and the game can simulate the next frame while
+    // this one is being drawn. It never gets more than one frame ahead of the render thread
+    // Resource calls like CreateModel or LoadTexture wait until the render thread gets to them
+    bool useRenderThread{ false };
+    // Both are needed for the render thread, otherwise it isn't started
+    // Makes the context current on the calling thread, or releases it if current is false
+    std::function<void( bool current )> makeContextCurrent;
+    // Presents a finished frame, e.g. SDL_GL_SwapWindow
+    std::function<void()> swapBuffers;
 };
 
 class IRenderWorld
@@ -104,6 +155,11 @@ public:
 
     // ========================================
     // Render entity manipulation
+    //
+    // UpdateEntity and CreateImmediateEntity can be called from several
+    // game threads at once, as long as no two threads update the same entity,
+    // and none of them overlap with the other calls of the renderworld,
+    // e.g. the game joins its threads before RenderFrame
 
     // Allocates a render entity and retrieves a handle
     // Once created, this entity will be rendered in the renderworld
@@ -112,19 +168,40 @@ public:
     // @returns true on success, false if the handle is invalid, or the params are invalid
     virtual bool                UpdateEntity( const RenderEntityHandle& handle, const RenderEntityParams& params ) = 0;
     // Submits the entity to the renderworld immediately, to be drawn this frame
-    // @returns true on success, false if the params are invalid
+    // @returns true on success, false if the params are invalid or there are too many this frame
     virtual bool                CreateImmediateEntity( const RenderEntityParams& params ) = 0;
     // Frees the render entity from the renderworld, no longer to be rendered again
     // If you wish to just hide entities, update render entity params instead
     virtual void                DestroyEntity( const RenderEntityHandle& handle ) = 0;
 
+    // ========================================
+    // Render batch manipulation
+    // ========================================
+
+    // Copies the batch data into the renderer, the params can be freed right after
+    // @returns BatchInvalid if there are too few params or there's no more room for them
+    virtual BatchHandle         CreateBatch( const RenderBatchParam* params, const uint32_t& batchSize ) = 0;
+    // Same as above, except the batch is made of compact params
+    // The materials drawn with it need shaders that support compact instancing
+    virtual BatchHandle         CreateBatch( const RenderBatchCompactParam* params, const uint32_t& batchSize ) = 0;
+    // Overwrites instances [first, first + count) of the batch, only that part gets uploaded
+    // Ranges updated within the same frame are merged together before uploading
+    // Writing past the end of the batch makes it bigger
+    // @returns false if the handle is invalid, if the batch was created with the other type of params,
+    // or if it had to grow and there's no GPU memory left for it, in which case it stays as it was
+    virtual bool                UpdateBatch( const BatchHandle& handle, const RenderBatchParam* params, const uint32_t& first, const uint32_t& count ) = 0;
+    virtual bool                UpdateBatch( const BatchHandle& handle, const RenderBatchCompactParam* params, const uint32_t& first, const uint32_t& count ) = 0;
+    // Frees the batch, render entities still using it are drawn as single instances
+    virtual void                DestroyBatch( const BatchHandle& handle ) = 0;
+
     // ========================================
     // Render model manipulation
 
     // Creates a model from given parameters
     virtual RenderModelHandle   CreateModel( const RenderModelParams& params ) = 0;
     // Updates a model dynamically, only for dynamic models
-    virtual void                UpdateModel( const RenderModelHandle& handle, const RenderModelParams& params ) = 0;
+    // @returns false if the handle is invalid or the new mesh doesn't fit into GPU memory
+    virtual bool                UpdateModel( const RenderModelHandle& handle, const RenderModelParams& params ) = 0;
 
     // ========================================
     // Material, texture and shader business
@@ -158,6 +235,14 @@ public:
     // Renders the view into a frame
     virtual void                RenderFrame( const RenderView& view ) = 0;
 
+    // ========================================
+    // Statistics
+
+    // @param framesAgo: 0 for the last frame that was drawn, up to FrameStats::HistorySize - 1
+    // @returns Timings and counters of that frame, all zeroes if there's no such frame
+    // With a render thread, the last frame drawn is the one before the last RenderFrame
+    virtual FrameStats          GetFrameStats( const uint32_t& framesAgo = 0 ) const = 0;
+
     // ========================================
     // Utilities
 
@@ -5,17 +5,34 @@ struct RenderBatchParam
     glm::mat4           modelMatrix;
 };
 
+// Half the size of RenderBatchParam, for big batches that don't need shearing
+// or non-uniform scale, the shader rebuilds the model matrix out of this
+struct RenderBatchCompactParam
+{
+    glm::vec4           positionScale; // xyz = position, w = uniform scale
+    glm::vec4           orientation; // unit quaternion, xyz = vector part, w = scalar part
+};
+
 struct RenderEntityParams
 {
     glm::vec3           position;
     glm::mat4           orientation; // and scale
     RenderModelHandle   model;
     int                 renderMask{ 0 }; // if 0, it gets rendered everywhere
+    // If set, position and orientation are relative to this render entity,
+    // and this one follows it around without the game having to update it
+    // Destroying the parent leaves its children where they are, without a parent
+    RenderEntityHandle  parent{ RenderHandleInvalid };
+
+    // Created with IRenderWorld::CreateBatch, the renderer keeps its own copy of the
+    // batch data, so the same batch can be shared by any number of render entities
+    BatchHandle         batch{ BatchInvalid };
 
-    // Must point to valid, living memory! The renderer doesn't copy the renderbatch
-    // data, it just references it
-    RenderBatchParam*   batch{ nullptr };
-    uint32_t            batchSize{ 0 };
+    // The entity won't move, or only very rarely. Static entities of the same model and
+    // render mask are drawn together from one batch the renderer keeps on the GPU, so they
+    // cost next to nothing per frame. Moving one uploads just its own matrix, while creating
+    // or destroying one rebuilds the batch. Static entities with their own batch are drawn like any other
+    bool                isStatic{ false };
 };
 
 /*
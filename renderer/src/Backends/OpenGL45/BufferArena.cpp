@@ -0,0 +1,274 @@
+#include "IRenderWorld.hpp"
+#include "IRenderer.hpp"
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include "BufferArena.hpp"
+#include "RingBuffer.hpp"
+#include "StateCache.hpp"
+#include "DebugOutput.hpp"
+
+#include <cstring>
+
+// =====================================================================
+// BufferArena::Init
+// =====================================================================
+void BufferArena::Init( const uint32_t& newElementSize, const uint32_t& capacity )
+{
+	elementSize = newElementSize;
+	bytesMoved = 0U;
+
+	allocator = OffsetAllocator( capacity, MaxRanges );
+	ranges.clear();
+	freeRanges.clear();
+	rangeOfNode.assign( MaxRanges, ArenaRangeInvalid );
+
+	glCreateBuffers( 1, &buffer );
+	glNamedBufferStorage( buffer, size_t( capacity ) * elementSize, nullptr, GL_DYNAMIC_STORAGE_BIT );
+	GLError( "BufferArena::Init: created the buffer" );
+}
+
+// =====================================================================
+// BufferArena::Shutdown
+// =====================================================================
+void BufferArena::Shutdown()
+{
+	if ( !buffer )
+	{
+		return;
+	}
+
+	glDeleteBuffers( 1, &buffer );
+	gStateCache.ForgetBuffer( buffer );
+	buffer = 0U;
+
+	allocator = OffsetAllocator();
+	ranges.clear();
+	freeRanges.clear();
+	rangeOfNode.clear();
+}
+
+// =====================================================================
+// BufferArena::Allocate
+// =====================================================================
+ArenaRange BufferArena::Allocate( const uint32_t& count )
+{
+	OffsetAllocator::Allocation allocation = allocator.Allocate( count );
+	if ( !allocation.IsValid() )
+	{
+		// A bigger buffer only helps if space is what ran out
+		if ( allocator.IsOutOfNodes() || !Grow( count ) )
+		{
+			return ArenaRangeInvalid;
+		}
+
+		allocation = allocator.Allocate( count );
+		if ( !allocation.IsValid() )
+		{
+			return ArenaRangeInvalid;
+		}
+	}
+
+	ArenaRange range;
+	if ( !freeRanges.empty() )
+	{
+		range = freeRanges.back();
+		freeRanges.pop_back();
+	}
+	else
+	{
+		range = ranges.size();
+		ranges.push_back( Range() );
+	}
+
+	ranges[range] = { allocation, allocation.offset, count };
+	rangeOfNode[allocation.metadata] = range;
+	return range;
+}
+
+// =====================================================================
+// BufferArena::Free
+// =====================================================================
+void BufferArena::Free( const ArenaRange& range )
+{
+	if ( range == ArenaRangeInvalid || range >= ranges.size() )
+	{
+		return;
+	}
+
+	Range& r = ranges[range];
+	if ( !r.allocation.IsValid() )
+	{
+		return;
+	}
+
+	rangeOfNode[r.allocation.metadata] = ArenaRangeInvalid;
+	allocator.Free( r.allocation );
+	r = Range();
+	freeRanges.push_back( range );
+}
+
+// =====================================================================
+// BufferArena::Upload
+// =====================================================================
+void BufferArena::Upload( const ArenaRange& range, const void* data, const uint32_t& first, const uint32_t& count )
+{
+	const Range& r = ranges[range];
+	if ( nullptr == data || !count || first + count > r.size )
+	{
+		return;
+	}
+
+	glNamedBufferSubData( buffer, size_t( r.offset + first ) * elementSize, size_t( count ) * elementSize, data );
+}
+
+// =====================================================================
+// BufferArena::UploadStaged
+// =====================================================================
+void BufferArena::UploadStaged( RingBuffer& staging, const ArenaRange& range, const void* data, const uint32_t& first, const uint32_t& count )
+{
+	const Range& r = ranges[range];
+	if ( nullptr == data || !count || first + count > r.size )
+	{
+		return;
+	}
+
+	const uint32_t numBytes = count * elementSize;
+	uint32_t stagingOffset = 0U;
+	void* stagingMemory = staging.Allocate( numBytes, elementSize, stagingOffset );
+
+	// The ring is full for this frame, let the driver deal with it
+	if ( nullptr == stagingMemory )
+	{
+		Upload( range, data, first, count );
+		return;
+	}
+
+	memcpy( stagingMemory, data, numBytes );
+	glCopyNamedBufferSubData( staging.GetBuffer(), buffer, stagingOffset, size_t( r.offset + first ) * elementSize, numBytes );
+}
+
+// =====================================================================
+// BufferArena::Defragment
+// =====================================================================
+uint32_t BufferArena::Defragment( const uint32_t& maxBytes )
+{
+	uint32_t movedNow = 0U;
+
+	while ( movedNow < maxBytes && !allocator.IsCompact() )
+	{
+		// Take the range at the very end...
+		const OffsetAllocator::Allocation last = allocator.GetLastAllocation();
+		const ArenaRange range = rangeOfNode[last.metadata];
+		Range& r = ranges[range];
+
+		// ...and see if there's a hole for it somewhere before. Both
+		// allocations are alive during the copy, so they can't overlap
+		const OffsetAllocator::Allocation moved = allocator.Allocate( r.size );
+		if ( !moved.IsValid() )
+		{
+			break;
+		}
+
+		if ( moved.offset > last.offset )
+		{
+			allocator.Free( moved );
+			break;
+		}
+
+		const uint32_t numBytes = r.size * elementSize;
+		glCopyNamedBufferSubData( buffer, buffer, size_t( last.offset ) * elementSize, size_t( moved.offset ) * elementSize, numBytes );
+
+		rangeOfNode[last.metadata] = ArenaRangeInvalid;
+		allocator.Free( last );
+
+		r.allocation = moved;
+		r.offset = moved.offset;
+		rangeOfNode[moved.metadata] = range;
+
+		movedNow += numBytes;
+	}
+
+	bytesMoved += movedNow;
+	return movedNow;
+}
+
+// =====================================================================
+// BufferArena::GetStats
+// =====================================================================
+GpuArenaStats BufferArena::GetStats() const
+{
+	const OffsetAllocator::StorageReport report = allocator.GetStorageReport();
+
+	GpuArenaStats stats;
+	stats.capacity = allocator.GetSize() * elementSize;
+	stats.used = (allocator.GetSize() - report.totalFreeSpace) * elementSize;
+	stats.largestFreeRegion = report.largestFreeRegion * elementSize;
+	stats.numFreeRegions = report.numFreeRegions;
+	stats.numAllocations = report.numAllocations;
+	stats.bytesMoved = bytesMoved;
+
+	// 0 when all the free space is in one piece, approaches 1 as it gets scattered
+	if ( report.totalFreeSpace )
+	{
+		stats.fragmentation = 1.0f - float( report.largestFreeRegion ) / float( report.totalFreeSpace );
+	}
+
+	return stats;
+}
+
+// =====================================================================
+// BufferArena::Grow
+// =====================================================================
+bool BufferArena::Grow( const uint32_t& extraElements )
+{
+	// The allocator has to take the new size, or it and the buffer would disagree
+	if ( !allocator.CanGrow() )
+	{
+		return false;
+	}
+
+	const uint32_t oldCapacity = allocator.GetSize();
+	uint32_t newCapacity = oldCapacity ? oldCapacity * 2U : extraElements;
+	while ( newCapacity - oldCapacity < extraElements )
+	{
+		newCapacity *= 2U;
+	}
+
+	uint32_t newBuffer = 0U;
+	glCreateBuffers( 1, &newBuffer );
+	glNamedBufferStorage( newBuffer, size_t( newCapacity ) * elementSize, nullptr, GL_DYNAMIC_STORAGE_BIT );
+
+	// Live ranges can be anywhere, so copy the whole thing. All on the GPU anyway
+	if ( oldCapacity )
+	{
+		glCopyNamedBufferSubData( buffer, newBuffer, 0, 0, size_t( oldCapacity ) * elementSize );
+	}
+
+	glDeleteBuffers( 1, &buffer );
+	gStateCache.ForgetBuffer( buffer );
+	GLError( "BufferArena::Grow: moved everything into a bigger buffer" );
+
+	buffer = newBuffer;
+	return allocator.Grow( newCapacity );
+}
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
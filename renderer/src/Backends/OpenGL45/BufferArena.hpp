@@ -0,0 +1,98 @@
+#pragma once
+
+#include "OffsetAllocator.hpp"
+
+class RingBuffer;
+
+// Handle to a range of elements within a BufferArena
+using ArenaRange = uint32_t;
+constexpr ArenaRange ArenaRangeInvalid = ~0U;
+
+// =====================================================================
+// BufferArena
+// 
+// One GPU buffer, sub-allocated through an OffsetAllocator. Offsets and
+// sizes are in elements (vertices, indices, instances), so they can be
+// used directly as base vertices, first indices and base instances.
+// 
+// Ranges are referred to by handles, not offsets. Defragment moves live
+// ranges towards the start of the buffer with glCopyNamedBufferSubData
+// and updates the offsets behind the handles, so the owners don't need
+// to know anything moved. If the buffer runs out of space, it is replaced
+// by a bigger one, so don't hold onto GetBuffer between allocations.
+// =====================================================================
+class BufferArena final
+{
+public:
+	static constexpr uint32_t MaxRanges = 1U << 16U;
+
+	// @param elementSize: size of one element in bytes
+	// @param capacity: initial size of the buffer, in elements
+	void		Init( const uint32_t& elementSize, const uint32_t& capacity );
+	void		Shutdown();
+
+	// @returns ArenaRangeInvalid if it doesn't fit even after growing
+	ArenaRange	Allocate( const uint32_t& count );
+	void		Free( const ArenaRange& range );
+	// Uploads elements [first, first + count) of the range
+	void		Upload( const ArenaRange& range, const void* data, const uint32_t& first, const uint32_t& count );
+	// Same as Upload, but the data goes through the staging ring and is copied on the GPU,
+	// so the driver doesn't have to wait until the range is no longer used
+	void		UploadStaged( RingBuffer& staging, const ArenaRange& range, const void* data, const uint32_t& first, const uint32_t& count );
+
+	// Moves ranges from the end of the buffer into holes closer to the start,
+	// until the arena is compact or maxBytes have been copied
+	// @returns How many bytes were moved
+	uint32_t	Defragment( const uint32_t& maxBytes );
+
+	// ArenaRangeInvalid is an empty range at the start of the buffer
+	uint32_t	GetOffset( const ArenaRange& range ) const { return range != ArenaRangeInvalid ? ranges[range].offset : 0U; }
+	uint32_t	GetSize( const ArenaRange& range ) const { return range != ArenaRangeInvalid ? ranges[range].size : 0U; }
+	uint32_t	GetBuffer() const { return buffer; }
+	uint32_t	GetElementSize() const { return elementSize; }
+
+	GpuArenaStats GetStats() const;
+	// Clears the per-frame part of the stats
+	void		ResetFrameStats() { bytesMoved = 0U; }
+
+private:
+	// Replaces the buffer with a bigger one that can fit at least this many more elements
+	// @returns false if the allocator can't take any more space, the buffer is left alone then
+	bool		Grow( const uint32_t& extraElements );
+
+	struct Range
+	{
+		OffsetAllocator::Allocation allocation;
+		uint32_t	offset{ 0U };
+		uint32_t	size{ 0U };
+	};
+
+	OffsetAllocator	allocator;
+	std::vector<Range> ranges;
+	std::vector<ArenaRange> freeRanges;
+	// Allocator node -> range handle, to find out whose data is being moved
+	std::vector<ArenaRange> rangeOfNode;
+
+	uint32_t	buffer{ 0U };
+	uint32_t	elementSize{ 0U };
+	uint32_t	bytesMoved{ 0U };
+};
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
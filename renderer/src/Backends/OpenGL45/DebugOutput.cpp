@@ -0,0 +1,148 @@
+#include "IRenderWorld.hpp"
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include "DebugOutput.hpp"
+
+#include <cstdio>
+
+#ifndef NDEBUG
+// The last thing the backend marked with GLError
+static const char* gLastCheckpoint = "nothing yet";
+#endif
+
+// =====================================================================
+// DebugSourceName
+// =====================================================================
+static const char* DebugSourceName( GLenum source )
+{
+	switch ( source )
+	{
+	case GL_DEBUG_SOURCE_API: return "API";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION: return "application";
+	default: return "other";
+	}
+}
+
+// =====================================================================
+// DebugTypeName
+// =====================================================================
+static const char* DebugTypeName( GLenum type )
+{
+	switch ( type )
+	{
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behaviour";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behaviour";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	default: return "other";
+	}
+}
+
+// =====================================================================
+// DebugSeverityName
+// =====================================================================
+static const char* DebugSeverityName( GLenum severity )
+{
+	switch ( severity )
+	{
+	case GL_DEBUG_SEVERITY_HIGH: return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+	case GL_DEBUG_SEVERITY_LOW: return "low";
+	default: return "notification";
+	}
+}
+
+// =====================================================================
+// DebugMessageCallback
+// =====================================================================
+static void GLAPIENTRY DebugMessageCallback( GLenum source, GLenum type, GLuint id, GLenum severity,
+											 GLsizei, const GLchar* message, const void* )
+{
+	printf( "OpenGL %s %s (%s severity, id %u): %s\n",
+			DebugSourceName( source ), DebugTypeName( type ), DebugSeverityName( severity ), id, message );
+
+#ifndef NDEBUG
+	if ( type == GL_DEBUG_TYPE_ERROR )
+	{
+		printf( "  last checkpoint: %s\n_________________________\n", gLastCheckpoint );
+	}
+#endif
+}
+
+// =====================================================================
+// InitDebugOutput
+// =====================================================================
+bool InitDebugOutput( const bool& synchronous )
+{
+	if ( !GLEW_KHR_debug && !GLEW_VERSION_4_3 )
+	{
+		printf( "OpenGL: KHR_debug is not supported, GL errors won't be reported\n" );
+		return false;
+	}
+
+	glEnable( GL_DEBUG_OUTPUT );
+	if ( synchronous )
+	{
+		glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+	}
+	else
+	{
+		glDisable( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+	}
+
+	glDebugMessageCallback( DebugMessageCallback, nullptr );
+	// Drivers like to chat about every buffer they allocate, only keep the things worth fixing
+	glDebugMessageControl( GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE );
+	glDebugMessageControl( GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE );
+
+	return true;
+}
+
+// =====================================================================
+// ShutdownDebugOutput
+// =====================================================================
+void ShutdownDebugOutput()
+{
+	if ( !GLEW_KHR_debug && !GLEW_VERSION_4_3 )
+	{
+		return;
+	}
+
+	glDebugMessageCallback( nullptr, nullptr );
+	glDisable( GL_DEBUG_OUTPUT );
+}
+
+#ifndef NDEBUG
+// =====================================================================
+// GLCheckpoint
+// =====================================================================
+void GLCheckpoint( const char* what )
+{
+	gLastCheckpoint = what;
+}
+#endif
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
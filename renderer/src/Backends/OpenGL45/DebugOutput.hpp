@@ -0,0 +1,48 @@
+#pragma once
+
+// =====================================================================
+// GL error reporting
+// 
+// Errors are reported by the driver through KHR_debug, the moment they
+// happen, instead of us asking glGetError after every call. That used to
+// be a round trip into the driver each time, and it only ever told us
+// that *something* went wrong since the previous check.
+// 
+// GLError marks what the backend has just done, so the debug callback
+// can say where an error came from. In release builds it compiles out
+// completely, its argument isn't even evaluated.
+// =====================================================================
+
+// Turns on debug output, if the context supports it
+// @param synchronous: report each message from within the GL call that caused it,
+// slower, but the checkpoint and the call stack are then exact
+// @returns false if KHR_debug is not available
+bool InitDebugOutput( const bool& synchronous );
+void ShutdownDebugOutput();
+
+#ifdef NDEBUG
+#define GLError( why ) ((void)0)
+#else
+// @param what: must outlive the call, a string literal is best
+void GLCheckpoint( const char* what );
+#define GLError( why ) GLCheckpoint( why )
+#endif
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
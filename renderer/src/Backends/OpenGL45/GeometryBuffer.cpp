@@ -0,0 +1,255 @@
+#include "IRenderWorld.hpp"
+#include "IRenderer.hpp"
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include "DebugOutput.hpp"
+#include "VertexBuffer.hpp"
+#include "BufferArena.hpp"
+#include "GeometryBuffer.hpp"
+#include "StateCache.hpp"
+
+// =====================================================================
+// GeometryBuffer::Init
+// =====================================================================
+void GeometryBuffer::Init()
+{
+	vertices.Init( VertexStride, InitialVertices );
+	indices.Init( sizeof( vertexid_t ), InitialIndices );
+
+	glCreateVertexArrays( InstanceLayout_MAX, vertexArrays );
+	for ( int layout = 0; layout < InstanceLayout_MAX; layout++ )
+	{
+		SetupVertexArray( InstanceLayout( layout ) );
+	}
+	GLError( "GeometryBuffer::Init: set up the VAOs" );
+
+	AttachBuffers();
+}
+
+// =====================================================================
+// GeometryBuffer::Shutdown
+// =====================================================================
+void GeometryBuffer::Shutdown()
+{
+	if ( !vertexArrays[0] )
+	{
+		return;
+	}
+
+	for ( const uint32_t& vertexArray : vertexArrays )
+	{
+		if ( vertexArray == gStateCache.GetVertexArray() )
+		{
+			gStateCache.BindVertexArray( 0 );
+		}
+	}
+
+	glDeleteVertexArrays( InstanceLayout_MAX, vertexArrays );
+	for ( uint32_t& vertexArray : vertexArrays )
+	{
+		vertexArray = 0U;
+	}
+
+	vertices.Shutdown();
+	indices.Shutdown();
+	attachedVertexBuffer = 0U;
+	attachedIndexBuffer = 0U;
+}
+
+// =====================================================================
+// GeometryBuffer::AddVertices
+// =====================================================================
+ArenaRange GeometryBuffer::AddVertices( const DrawMesh* mesh )
+{
+	vertexScratch.clear();
+	vertexScratch.reserve( mesh->vertices.size() * VertexStride / sizeof( float ) );
+
+	for ( const DrawVertex& vert : mesh->vertices )
+	{
+		vertexScratch.push_back( vert.position.x );
+		vertexScratch.push_back( vert.position.y );
+		vertexScratch.push_back( vert.position.z );
+
+		vertexScratch.push_back( (float)vert.normal.x / 127.0f );
+		vertexScratch.push_back( (float)vert.normal.y / 127.0f );
+		vertexScratch.push_back( (float)vert.normal.z / 127.0f );
+
+		vertexScratch.push_back( (float)vert.texCoords.x / 32767.0f );
+		vertexScratch.push_back( (float)vert.texCoords.y / 32767.0f );
+	}
+
+	const uint32_t count = mesh->vertices.size();
+	const ArenaRange range = vertices.Allocate( count );
+	if ( range == ArenaRangeInvalid )
+	{
+		return ArenaRangeInvalid;
+	}
+
+	AttachBuffers();
+	vertices.Upload( range, vertexScratch.data(), 0U, count );
+	return range;
+}
+
+// =====================================================================
+// GeometryBuffer::AddIndices
+// =====================================================================
+ArenaRange GeometryBuffer::AddIndices( const std::vector<vertexid_t>& indexData )
+{
+	const uint32_t count = indexData.size();
+	const ArenaRange range = indices.Allocate( count );
+	if ( range == ArenaRangeInvalid )
+	{
+		return ArenaRangeInvalid;
+	}
+
+	AttachBuffers();
+	indices.Upload( range, indexData.data(), 0U, count );
+	return range;
+}
+
+// =====================================================================
+// GeometryBuffer::FreeVertices
+// =====================================================================
+void GeometryBuffer::FreeVertices( const ArenaRange& range )
+{
+	vertices.Free( range );
+}
+
+// =====================================================================
+// GeometryBuffer::FreeIndices
+// =====================================================================
+void GeometryBuffer::FreeIndices( const ArenaRange& range )
+{
+	indices.Free( range );
+}
+
+// =====================================================================
+// GeometryBuffer::Defragment
+// =====================================================================
+uint32_t GeometryBuffer::Defragment( const uint32_t& maxBytes )
+{
+	// Ranges only move within their buffers, the VAOs stay as they are
+	const uint32_t movedVertexBytes = vertices.Defragment( maxBytes );
+	if ( movedVertexBytes >= maxBytes )
+	{
+		return movedVertexBytes;
+	}
+
+	return movedVertexBytes + indices.Defragment( maxBytes - movedVertexBytes );
+}
+
+// =====================================================================
+// GeometryBuffer::ResetFrameStats
+// =====================================================================
+void GeometryBuffer::ResetFrameStats()
+{
+	vertices.ResetFrameStats();
+	indices.ResetFrameStats();
+}
+
+// =====================================================================
+// GeometryBuffer::Bind
+// =====================================================================
+void GeometryBuffer::Bind( const InstanceLayout& layout ) const
+{
+	gStateCache.BindVertexArray( vertexArrays[layout] );
+}
+
+// =====================================================================
+// GeometryBuffer::SetInstanceBuffer
+// =====================================================================
+void GeometryBuffer::SetInstanceBuffer( const InstanceLayout& layout, uint32_t buffer )
+{
+	if ( layout == InstanceLayout_None )
+	{
+		return;
+	}
+
+	// Not cached: buffer names of deleted arenas can be reused by new ones,
+	// while the VAO would still point to the old buffer
+	glVertexArrayVertexBuffer( vertexArrays[layout], InstanceBinding, buffer, 0, GetInstanceStride( layout ) );
+}
+
+// =====================================================================
+// GeometryBuffer::SetupVertexArray
+// =====================================================================
+void GeometryBuffer::SetupVertexArray( const InstanceLayout& layout )
+{
+	using attribs = VertexAttributes;
+	using offsets = VertexAttribOffsets;
+
+	const uint32_t vao = vertexArrays[layout];
+
+	// Per-vertex data, same in every layout
+	const auto setupAttrib = [vao]( const int& attrib, const int& size, const int& offset, const uint32_t& binding )
+	{
+		glEnableVertexArrayAttrib( vao, attrib );
+		glVertexArrayAttribFormat( vao, attrib, size, GL_FLOAT, GL_FALSE, offset );
+		glVertexArrayAttribBinding( vao, attrib, binding );
+	};
+
+	setupAttrib( attribs::Positions, 3, offsets::Positions, VertexBinding );
+	setupAttrib( attribs::Normals, 3, offsets::Normals, VertexBinding );
+	setupAttrib( attribs::TexCoords, 2, offsets::TexCoords, VertexBinding );
+
+	// Per-instance data, the buffer comes later in SetInstanceBuffer
+	if ( layout == InstanceLayout_Matrix )
+	{
+		for ( int column = 0; column < 4; column++ )
+		{
+			setupAttrib( attribs::BatchModelMatrix + column, 4, offsets::BatchModelMatrix + offsets::Vec4Size * column, InstanceBinding );
+		}
+
+		glVertexArrayBindingDivisor( vao, InstanceBinding, 1 );
+	}
+	else if ( layout == InstanceLayout_Compact )
+	{
+		setupAttrib( attribs::BatchPositionScale, 4, offsets::BatchPositionScale, InstanceBinding );
+		setupAttrib( attribs::BatchOrientation, 4, offsets::BatchOrientation, InstanceBinding );
+
+		glVertexArrayBindingDivisor( vao, InstanceBinding, 1 );
+	}
+}
+
+// =====================================================================
+// GeometryBuffer::AttachBuffers
+// =====================================================================
+void GeometryBuffer::AttachBuffers()
+{
+	if ( attachedVertexBuffer == vertices.GetBuffer() && attachedIndexBuffer == indices.GetBuffer() )
+	{
+		return;
+	}
+
+	attachedVertexBuffer = vertices.GetBuffer();
+	attachedIndexBuffer = indices.GetBuffer();
+
+	for ( const uint32_t& vertexArray : vertexArrays )
+	{
+		glVertexArrayVertexBuffer( vertexArray, VertexBinding, attachedVertexBuffer, 0, VertexStride );
+		glVertexArrayElementBuffer( vertexArray, attachedIndexBuffer );
+	}
+
+	GLError( "GeometryBuffer::AttachBuffers: attached the VBO and EBO to the VAOs" );
+}
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
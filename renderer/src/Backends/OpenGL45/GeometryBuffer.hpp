@@ -0,0 +1,86 @@
+#pragma once
+
+// =====================================================================
+// GeometryBuffer
+// 
+// Holds the vertices and indices of every model with the same vertex
+// format, in one big VBO and one big EBO. Surfaces are sub-allocated
+// from them and drawn with a base vertex and a first index, so switching
+// models doesn't mean switching vertex arrays, and one multi-draw can
+// go through surfaces of many different models.
+// 
+// There is one VAO per instance layout. The vertex attributes are the
+// same in all of them, they only differ in the per-instance attributes.
+// =====================================================================
+class GeometryBuffer final
+{
+public:
+	// Position, normal, texture coordinates
+	static constexpr uint32_t VertexStride = 8U * sizeof( float );
+	static constexpr uint32_t VertexBinding = 0U;
+	static constexpr uint32_t InstanceBinding = 1U;
+
+	// Starting capacity, the arenas double in size when they run out
+	static constexpr uint32_t InitialVertices = 1U << 16U;
+	static constexpr uint32_t InitialIndices = 3U << 16U;
+
+	void		Init();
+	void		Shutdown();
+
+	// Converts the mesh into this buffer's vertex format and uploads it
+	// @returns The range of the mesh's vertices, its offset is the base vertex
+	ArenaRange	AddVertices( const DrawMesh* mesh );
+	// The indices stay relative to the mesh, draws add the base vertex
+	// @returns The range of the indices, its offset is the first index
+	ArenaRange	AddIndices( const std::vector<vertexid_t>& indices );
+	void		FreeVertices( const ArenaRange& range );
+	void		FreeIndices( const ArenaRange& range );
+
+	// Moves vertices and indices into holes left behind by freed models
+	// @returns How many bytes were moved
+	uint32_t	Defragment( const uint32_t& maxBytes );
+	void		ResetFrameStats();
+
+	// Binds the VAO for this instance layout
+	void		Bind( const InstanceLayout& layout ) const;
+	// Makes the instanced VAO read its per-instance attributes from this buffer
+	void		SetInstanceBuffer( const InstanceLayout& layout, uint32_t buffer );
+
+	uint32_t	GetVertexArray( const InstanceLayout& layout ) const { return vertexArrays[layout]; }
+	const BufferArena& GetVertices() const { return vertices; }
+	const BufferArena& GetIndices() const { return indices; }
+
+private:
+	void		SetupVertexArray( const InstanceLayout& layout );
+	// Points all the VAOs to the arenas' buffers, if they got replaced
+	void		AttachBuffers();
+
+	uint32_t	vertexArrays[InstanceLayout_MAX]{};
+	BufferArena	vertices;
+	BufferArena	indices;
+	// What the VAOs currently point to
+	uint32_t	attachedVertexBuffer{ 0U };
+	uint32_t	attachedIndexBuffer{ 0U };
+
+	// Vertices are converted here before uploading
+	std::vector<float> vertexScratch;
+};
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
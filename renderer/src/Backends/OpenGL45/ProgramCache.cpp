@@ -0,0 +1,205 @@
+#include "IRenderWorld.hpp"
+#include "ProgramCache.hpp"
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+ProgramCache gProgramCache;
+
+// =====================================================================
+// ProgramCache::Init
+// =====================================================================
+void ProgramCache::Init( const char* cacheDirectory )
+{
+	numHits = 0U;
+	numMisses = 0U;
+	enabled = false;
+
+	if ( nullptr == cacheDirectory || !cacheDirectory[0] )
+	{
+		return;
+	}
+
+	// Some drivers don't give out any binary formats, so there's nothing to cache
+	GLint numFormats = 0;
+	glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats );
+	if ( numFormats <= 0 )
+	{
+		printf( "ProgramCache: the driver has no program binary formats, the cache is off\n" );
+		return;
+	}
+
+	std::error_code error;
+	fs::create_directories( cacheDirectory, error );
+	if ( error )
+	{
+		printf( "ProgramCache: cannot create '%s', the cache is off\n", cacheDirectory );
+		return;
+	}
+
+	directory = cacheDirectory;
+
+	// Binaries from another driver, or another version of it, may not load, or worse
+	driverHash = HashSeed;
+	for ( GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION } )
+	{
+		const char* driverString = reinterpret_cast<const char*>( glGetString( name ) );
+		if ( nullptr != driverString )
+		{
+			driverHash = Hash( driverString, strlen( driverString ), driverHash );
+		}
+	}
+
+	enabled = true;
+}
+
+// =====================================================================
+// ProgramCache::Hash
+// =====================================================================
+uint64_t ProgramCache::Hash( const void* data, const size_t& size, const uint64_t& seed )
+{
+	constexpr uint64_t Prime = 1099511628211ULL;
+
+	const uint8_t* bytes = static_cast<const uint8_t*>( data );
+	uint64_t hash = seed;
+	for ( size_t i = 0U; i < size; i++ )
+	{
+		hash ^= bytes[i];
+		hash *= Prime;
+	}
+
+	return hash;
+}
+
+// =====================================================================
+// ProgramCache::MakeKey
+// =====================================================================
+uint64_t ProgramCache::MakeKey( const uint64_t& vertexHash, const uint64_t& fragmentHash, const uint16_t& shaderFlags ) const
+{
+	uint64_t key = driverHash;
+	key = Hash( &vertexHash, sizeof( vertexHash ), key );
+	key = Hash( &fragmentHash, sizeof( fragmentHash ), key );
+	key = Hash( &shaderFlags, sizeof( shaderFlags ), key );
+	return key;
+}
+
+// =====================================================================
+// ProgramCache::Load
+// =====================================================================
+bool ProgramCache::Load( const uint32_t& program, const uint64_t& key )
+{
+	if ( !enabled )
+	{
+		return false;
+	}
+
+	std::ifstream file( GetPath( key ), std::ios::binary );
+	if ( !file )
+	{
+		numMisses++;
+		return false;
+	}
+
+	FileHeader header{};
+	file.read( reinterpret_cast<char*>( &header ), sizeof( header ) );
+	if ( !file || header.magic != FileMagic || header.key != key || !header.binaryLength )
+	{
+		numMisses++;
+		return false;
+	}
+
+	std::vector<char> binary( header.binaryLength );
+	file.read( binary.data(), binary.size() );
+	if ( !file )
+	{
+		numMisses++;
+		return false;
+	}
+
+	// The driver can still refuse it, e.g. after an update that didn't change the version string
+	glProgramBinary( program, header.binaryFormat, binary.data(), binary.size() );
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv( program, GL_LINK_STATUS, &linked );
+	if ( !linked )
+	{
+		numMisses++;
+		return false;
+	}
+
+	numHits++;
+	return true;
+}
+
+// =====================================================================
+// ProgramCache::Store
+// =====================================================================
+void ProgramCache::Store( const uint32_t& program, const uint64_t& key )
+{
+	if ( !enabled )
+	{
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+	if ( length <= 0 )
+	{
+		return;
+	}
+
+	std::vector<char> binary( length );
+	GLenum binaryFormat = 0;
+	glGetProgramBinary( program, length, &length, &binaryFormat, binary.data() );
+	if ( length <= 0 )
+	{
+		return;
+	}
+
+	FileHeader header{};
+	header.magic = FileMagic;
+	header.binaryFormat = binaryFormat;
+	header.key = key;
+	header.binaryLength = length;
+
+	std::ofstream file( GetPath( key ), std::ios::binary | std::ios::trunc );
+	file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+	file.write( binary.data(), length );
+}
+
+// =====================================================================
+// ProgramCache::GetPath
+// =====================================================================
+std::string ProgramCache::GetPath( const uint64_t& key ) const
+{
+	char fileName[32];
+	snprintf( fileName, sizeof( fileName ), "%016llx.bin", static_cast<unsigned long long>( key ) );
+	return (fs::path( directory ) / fileName).string();
+}
+
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+
+// =====================================================================
+// ProgramCache
+// 
+// Keeps linked program binaries on disk, so shader permutations don't
+// have to be compiled from source again on the next start. Each binary
+// is keyed by a hash of its full source, its shader flags and the
+// driver's vendor, renderer and version strings, so a driver update or
+// a changed shader just misses the cache and gets compiled again.
+// =====================================================================
+class ProgramCache final
+{
+public:
+	// Reads the driver strings, needs a current context
+	// @param cacheDirectory: where the binaries are kept, nullptr or empty turns the cache off
+	void		Init( const char* cacheDirectory );
+
+	// @returns A 64-bit FNV-1a hash of the data, continuing from seed
+	static uint64_t Hash( const void* data, const size_t& size, const uint64_t& seed = HashSeed );
+
+	// @returns The key of a program built from this source, with these flags, on this driver
+	// @param vertexHash, fragmentHash: hashes of the expanded sources, see ShaderPreprocessor
+	uint64_t	MakeKey( const uint64_t& vertexHash, const uint64_t& fragmentHash, const uint16_t& shaderFlags ) const;
+	// Links the program from its cached binary
+	// @returns true if the program is linked, false if it has to be compiled from source
+	bool		Load( const uint32_t& program, const uint64_t& key );
+	// Writes the binary of a freshly linked program into the cache
+	// The program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	void		Store( const uint32_t& program, const uint64_t& key );
+
+	bool		IsEnabled() const { return enabled; }
+
+	// @returns How many programs were loaded from the cache, and how many weren't there, since Init
+	uint32_t	GetNumHits() const { return numHits; }
+	uint32_t	GetNumMisses() const { return numMisses; }
+
+	static constexpr uint64_t HashSeed = 14695981039346656037ULL;
+
+private:
+	std::string	GetPath( const uint64_t& key ) const;
+
+	// At the start of every cache file
+	struct FileHeader
+	{
+		uint32_t	magic;
+		uint32_t	binaryFormat;
+		uint64_t	key;
+		uint32_t	binaryLength;
+	};
+
+	// "FGLP"
+	static constexpr uint32_t FileMagic = 0x504C4746U;
+
+	std::string	directory;
+	// Hash of the vendor, renderer and version strings
+	uint64_t	driverHash{ HashSeed };
+	bool		enabled{ false };
+
+	uint32_t	numHits{ 0U };
+	uint32_t	numMisses{ 0U };
+};
+
+extern ProgramCache gProgramCache;
+
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -8,65 +8,24 @@
 
 #define GLEW_STATIC 1
 #include <GL/glew.h>
+#include "DebugOutput.hpp"
 #include "VertexBuffer.hpp"
+#include "BufferArena.hpp"
+#include "GeometryBuffer.hpp"
+#include "RingBuffer.hpp"
+#include "StateCache.hpp"
+#include "ProgramCache.hpp"
 
 #include "Renderer.hpp"
 
 #include "glm/gtc/matrix_transform.hpp"
+#include <cstring>
 
 IRenderer* AllocateRenderer45()
 {
 	return new Renderer_OpenGL45();
 }
 
-bool CanErrorPrint = true;
-
-#define glErrorInfo( glEnum ) { glEnum, #glEnum },
-const char* glTranslateError( GLenum error )
-{
-	struct GLErrorInfo { int glEnum; const char* glString; };
-	constexpr GLErrorInfo errorEnumStrings[] =
-	{
-		glErrorInfo( GL_INVALID_ENUM )
-		glErrorInfo( GL_INVALID_FRAMEBUFFER_OPERATION )
-		glErrorInfo( GL_INVALID_INDEX )
-		glErrorInfo( GL_INVALID_VALUE )
-		glErrorInfo( GL_INVALID_OPERATION )
-		glErrorInfo( GL_STACK_OVERFLOW )
-		glErrorInfo( GL_STACK_UNDERFLOW )
-		glErrorInfo( GL_OUT_OF_MEMORY )
-	};
-
-	for ( const auto& errorInfo : errorEnumStrings )
-	{
-		if ( error == errorInfo.glEnum )
-			return errorInfo.glString;
-	}
-
-	return (const char*)glewGetErrorString( error );
-}
-#undef glErrorInfo
-
-bool GLError( const char* why = nullptr )
-{
-	if ( !CanErrorPrint )
-		return false;
-
-	printf( "OpenGL: %s", why );
-
-	auto error = glGetError();
-	if ( error != GL_NO_ERROR )
-	{
-		printf( "\ngot an error: 0x%x | %i (%s)\n_________________________\n", 
-				error, error, glTranslateError( error ) );
-		return true;
-	}
-
-	printf( ", went OK\n" );
-
-	return false;
-}
-
 // =====================================================================
 // Renderer_OpenGL45::Init
 // =====================================================================
@@ -79,6 +38,35 @@ bool Renderer_OpenGL45::Init( const RenderInitParams& params )
 		return false;
 	}
 
+	// Errors are reported by the driver as they happen, rather than polled for
+	if ( params.debugOutput )
+	{
+#ifdef NDEBUG
+		InitDebugOutput( false );
+#else
+		InitDebugOutput( true );
+#endif
+	}
+
+	// Nothing is bound in a fresh context, but we don't know who used it before us
+	gStateCache.Invalidate();
+	// Before any shader gets compiled, so even the default one can come from the cache
+	gProgramCache.Init( params.shaderCacheDirectory );
+
+	// Let the driver compile shaders on as many threads as it likes
+	if ( GLEW_KHR_parallel_shader_compile )
+	{
+		glMaxShaderCompilerThreadsKHR( 0xFFFFFFFFU );
+		Shader::canPollCompletion = true;
+	}
+	else if ( GLEW_ARB_parallel_shader_compile )
+	{
+		glMaxShaderCompilerThreadsARB( 0xFFFFFFFFU );
+		Shader::canPollCompletion = true;
+	}
+
+	Shader::recordUsage = params.recordShaderUsage;
+
 	// Build the default shader
 	if ( !InitDefaultShader() )
 	{
@@ -88,7 +76,36 @@ bool Renderer_OpenGL45::Init( const RenderInitParams& params )
 
 	GLError( "built the default shader" );
 
-	vertexBuffers.clear();
+	vertexArrays.clear();
+	staticGeometry.Init();
+	instanceArena.Init( sizeof( RenderBatchParam ), InitialInstances );
+	compactInstanceArena.Init( sizeof( RenderBatchCompactParam ), InitialInstances );
+	streamBuffer.Init( StreamBufferFrameSize );
+
+	for ( TimerQuery& timer : timerQueries )
+	{
+		glCreateQueries( GL_TIME_ELAPSED, 1, &timer.query );
+		timer.pending = false;
+	}
+	frameNumber = 0U;
+
+	GLint alignment = 0;
+	glGetIntegerv( GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment );
+	if ( alignment > 0 )
+	{
+		storageBufferAlignment = alignment;
+	}
+
+	// The view matrices are uploaded once per view, shared by every program
+	glCreateBuffers( 1, &viewUniformBuffer );
+	glNamedBufferStorage( viewUniformBuffer, sizeof( ViewUniforms ), nullptr, GL_DYNAMIC_STORAGE_BIT );
+	GLError( "created the view uniform buffer" );
+
+	// Multi-draw indirect needs gl_BaseInstanceARB to find the per-draw data
+	indirectSupported = GLEW_ARB_shader_draw_parameters;
+	glCreateBuffers( 1, &indirectCommandBuffer );
+	glCreateBuffers( 1, &drawDataBuffer );
+	GLError( "created the indirect drawing buffers" );
 
 	return true;
 }
@@ -99,7 +116,38 @@ bool Renderer_OpenGL45::Init( const RenderInitParams& params )
 void Renderer_OpenGL45::Shutdown()
 {
 	vertexArrays.clear();
-	vertexBuffers.clear();
+	instancedArrays.clear();
+	dirtyBatches.clear();
+	freeBatches.clear();
+	staticGeometry.Shutdown();
+	instanceArena.Shutdown();
+	compactInstanceArena.Shutdown();
+	streamBuffer.Shutdown();
+
+	for ( TimerQuery& timer : timerQueries )
+	{
+		if ( timer.query )
+		{
+			glDeleteQueries( 1, &timer.query );
+			timer.query = 0;
+		}
+	}
+
+	ShutdownDebugOutput();
+
+	if ( viewUniformBuffer )
+	{
+		glDeleteBuffers( 1, &viewUniformBuffer );
+		viewUniformBuffer = 0;
+	}
+
+	if ( indirectCommandBuffer )
+	{
+		glDeleteBuffers( 1, &indirectCommandBuffer );
+		glDeleteBuffers( 1, &drawDataBuffer );
+		indirectCommandBuffer = 0;
+		drawDataBuffer = 0;
+	}
 }
 
 // =====================================================================
@@ -125,10 +173,32 @@ void Renderer_OpenGL45::BeginFrame()
 {
 	numDrawCalls = 0;
 	numDrawnTriangles = 0;
+	gStateCache.ResetCounters();
+	staticGeometry.ResetFrameStats();
+	instanceArena.ResetFrameStats();
+	compactInstanceArena.ResetFrameStats();
+
+	// Batch data has to be there before anything is drawn
+	numBatchBytesUploaded = 0;
+	numBatchBytesSaved = 0;
+	numStreamBytesUploaded = 0;
+	numStreamBufferStalls = streamBuffer.GetNumStalls();
+
+	// If the GPU is so far behind that this query is still pending,
+	// this frame just isn't timed, rather than waiting for it
+	TimerQuery& timer = timerQueries[frameNumber % NumTimerQueries];
+	timingFrame = !timer.pending;
+	if ( timingFrame )
+	{
+		glBeginQuery( GL_TIME_ELAPSED, timer.query );
+		timer.frameNumber = frameNumber;
+	}
 
-	glEnable( GL_DEPTH_TEST );
-	glEnable( GL_CULL_FACE );
-	glCullFace( GL_BACK );
+	FlushDirtyBatches();
+
+	gStateCache.SetEnabled( GL_DEPTH_TEST, true );
+	gStateCache.SetEnabled( GL_CULL_FACE, true );
+	gStateCache.CullFace( GL_BACK );
 	glDepthRange( 0.01f, 8192.0f );
 }
 
@@ -137,12 +207,75 @@ void Renderer_OpenGL45::BeginFrame()
 // =====================================================================
 void Renderer_OpenGL45::EndFrame()
 {
-	glBindVertexArray( 0 );
-	glBindBuffer( GL_ARRAY_BUFFER, 0 );
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
-	glUseProgram( 0 );
+	gStateCache.BindVertexArray( 0 );
+	gStateCache.BindBuffer( GL_ARRAY_BUFFER, 0 );
+	gStateCache.UseProgram( 0 );
+
+	// Everything for this frame has been submitted, so anything moved
+	// from now on will be in its new place for the next frame
+	staticGeometry.Defragment( DefragmentBytesPerFrame );
+	instanceArena.Defragment( DefragmentBytesPerFrame );
+	compactInstanceArena.Defragment( DefragmentBytesPerFrame );
 
-	printf( "## Draw calls: %i\n## Triangles: %6.1f K (%3.3f million)\n", (int)numDrawCalls, (numDrawnTriangles / 1000.0f), (numDrawnTriangles / 1000.0f / 1000.0f) );
+	if ( timingFrame )
+	{
+		glEndQuery( GL_TIME_ELAPSED );
+		timerQueries[frameNumber % NumTimerQueries].pending = true;
+	}
+	frameNumber++;
+
+	// This frame's region is done, the next one might still be in use by the GPU
+	streamBuffer.NextFrame();
+}
+
+// =====================================================================
+// Renderer_OpenGL45::GetFrameCounters
+// =====================================================================
+void Renderer_OpenGL45::GetFrameCounters( FrameStats& stats ) const
+{
+	stats.numDrawCalls = numDrawCalls;
+	stats.numTriangles = numDrawnTriangles;
+	stats.numStateChanges = gStateCache.GetNumStateChanges();
+	stats.numSkippedStateChanges = gStateCache.GetNumSkippedCalls();
+	stats.numUploadedBytes = numBatchBytesUploaded + numStreamBytesUploaded;
+	stats.numBatchBytesSaved = numBatchBytesSaved;
+	stats.numStreamBufferStalls = streamBuffer.GetNumStalls() - numStreamBufferStalls;
+}
+
+// =====================================================================
+// Renderer_OpenGL45::GetGpuFrameTime
+// =====================================================================
+bool Renderer_OpenGL45::GetGpuFrameTime( uint64_t& outFrameNumber, float& milliseconds )
+{
+	// Queries finish in order, so if the oldest one isn't done, neither are the others
+	TimerQuery* oldest = nullptr;
+	for ( TimerQuery& timer : timerQueries )
+	{
+		if ( timer.pending && (nullptr == oldest || timer.frameNumber < oldest->frameNumber) )
+		{
+			oldest = &timer;
+		}
+	}
+
+	if ( nullptr == oldest )
+	{
+		return false;
+	}
+
+	GLint available = GL_FALSE;
+	glGetQueryObjectiv( oldest->query, GL_QUERY_RESULT_AVAILABLE, &available );
+	if ( !available )
+	{
+		return false;
+	}
+
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v( oldest->query, GL_QUERY_RESULT, &nanoseconds );
+	oldest->pending = false;
+
+	outFrameNumber = oldest->frameNumber;
+	milliseconds = nanoseconds / (1000.0f * 1000.0f);
+	return true;
 }
 
 // =====================================================================
@@ -154,10 +287,11 @@ IShader* Renderer_OpenGL45::CreateShader( const char* shaderFile )
 	if ( newShader->Load( shaderFile ) )
 	{
 		newShader->Compile();
-		GLError( std::string( "CreateShader: attempted to compile shader " ).append( shaderFile ).c_str() );
+		GLError( "CreateShader: attempted to compile a shader" );
 		return newShader;
 	}
 
+	printf( "Error in filesystem: %s\n", newShader->GetErrorMessage() );
 	delete newShader;
 	return nullptr;
 }
@@ -167,30 +301,127 @@ IShader* Renderer_OpenGL45::CreateShader( const char* shaderFile )
 // =====================================================================
 void Renderer_OpenGL45::ReloadShaders()
 {
-	defaultShader.Reload();
+	// Everything else falls back onto the default shader, so it has to be ready right away
+	if ( !defaultShader.Reload() )
+	{
+		printf( "Cannot reload the default shader, keeping the old one: %s\n", defaultShader.GetErrorMessage() );
+	}
+	defaultShader.WaitForCompile();
 	GLError( "ReloadShaders: reloaded default shader" );
 }
 
 // =====================================================================
 // Renderer_OpenGL45::RenderSurfaceBatch
 // =====================================================================
-void Renderer_OpenGL45::RenderSurfaceBatch( const RenderEntityParams& params, const int& surface,
+void Renderer_OpenGL45::RenderSurfaceBatch( const RenderModelHandle& model, const glm::mat4& modelMatrix, const int& surface,
 											const BatchHandle& batchHandle, const int& batchSize )
 {
-	CanErrorPrint = false;
-
 	// Get the render data stuff
-	VertexArray& va = vertexArrays[params.model].at( surface );
-	ITexture* tex = va.GetMaterial()->GetTexture( TextureType_Albedo, 0 );
-	IShader* shader = va.GetMaterial()->GetShader();
+	VertexArray& va = vertexArrays[model].at( surface );
+	if ( batchSize > BatchSizeThreshold )
+	{
+		const InstancedArray& ia = instancedArrays[batchHandle];
+		DrawVertexArray( va, &modelMatrix, ia.GetLayout(), ia.GetHandle(), ia.GetBaseInstance(), batchSize );
+	}
+	else
+	{
+		DrawVertexArray( va, &modelMatrix, InstanceLayout_None, 0U, 0U, 0U );
+	}
+}
+
+// =====================================================================
+// Renderer_OpenGL45::AllocateTransientInstances
+// =====================================================================
+RenderBatchParam* Renderer_OpenGL45::AllocateTransientInstances( const uint32_t& numInstances, uint32_t& outFirstInstance )
+{
+	constexpr uint32_t InstanceSize = sizeof( RenderBatchParam );
+
+	// Aligned to whole instances, so the offset works as a base instance
+	uint32_t offset = 0U;
+	void* memory = streamBuffer.Allocate( numInstances * InstanceSize, InstanceSize, offset );
+	outFirstInstance = offset / InstanceSize;
+	if ( nullptr != memory )
+	{
+		numStreamBytesUploaded += numInstances * InstanceSize;
+	}
+
+	return static_cast<RenderBatchParam*>( memory );
+}
+
+// =====================================================================
+// Renderer_OpenGL45::RenderSurfaceInstances
+// =====================================================================
+void Renderer_OpenGL45::RenderSurfaceInstances( const RenderModelHandle& model, const int& surface,
+												const uint32_t& firstInstance, const int& numInstances )
+{
+	VertexArray& va = vertexArrays[model].at( surface );
+	DrawVertexArray( va, nullptr, InstanceLayout_Matrix, streamBuffer.GetBuffer(), firstInstance, numInstances );
+}
+
+// =====================================================================
+// Renderer_OpenGL45::DrawVertexArray
+// =====================================================================
+void Renderer_OpenGL45::DrawVertexArray( VertexArray& va, const glm::mat4* modelMatrix, const InstanceLayout& layout,
+										 const uint32_t& instanceBuffer, const uint32_t& baseInstance, const uint32_t& numInstances )
+{
+	// Empty surface, not worth binding anything for
+	if ( !va.GetNumIndices() )
+	{
+		return;
+	}
+
+	const bool instanced = (numInstances > BatchSizeThreshold) && (layout != InstanceLayout_None);
 
 	uint16_t shaderFlags = ShaderFlag_Normal;
-	if ( batchSize > BatchSizeThreshold )
+	if ( instanced )
 	{
 		shaderFlags |= ShaderFlag_Instanced;
+		if ( layout == InstanceLayout_Compact )
+		{
+			shaderFlags |= ShaderFlag_CompactInstanced;
+		}
+	}
+
+	IShader* shader = BindMaterial( va.GetMaterial(), shaderFlags );
+
+	// Projection and view come from the view uniform buffer
+	SetupModelMatrix( modelMatrix, shader );
+
+	// Bind the VA so we know what we're supposed to render,
+	// along with the instanced array if there is one
+	if ( instanced )
+	{
+		va.GetGeometry()->SetInstanceBuffer( layout, instanceBuffer );
+		va.Bind( layout );
+	}
+	else
+	{
+		va.Bind();
+	}
+
+	// GPU, RENDER NOW!
+	PerformDrawCall( va, numInstances, baseInstance );
+}
+
+// =====================================================================
+// Renderer_OpenGL45::BindMaterial
+// =====================================================================
+IShader* Renderer_OpenGL45::BindMaterial( IMaterial* material, const uint16_t& shaderFlags )
+{
+	ITexture* tex = material->GetTexture( TextureType_Albedo, 0 );
+	IShader* shader = material->GetShader();
+
+	// Shaders compile in the background, so loading or reloading them never stalls
+	// the frame. Until then, whatever uses them is drawn with the default shader,
+	// which has to be waited for if it's the first time it's needed with these flags
+	if ( !shader->IsReady( shaderFlags ) )
+	{
+		shader = &defaultShader;
+		defaultShader.WaitForCompile( shaderFlags );
 	}
 
 	// Bind the shader
+	const uint32_t lastProgram = gStateCache.GetProgram();
 	shader->Bind( shaderFlags );
 
 	// -------------------------------------
@@ -198,33 +429,84 @@ void Renderer_OpenGL45::RenderSurfaceBatch( const RenderEntityParams& params, co
 	// Move this stuff to the Material class
 	tex->Bind( 0 );
 
-	static uint32_t textureUniformHandle = 0;
-	if ( !textureUniformHandle )
+	// Uniform handles are name hashes, the same for every shader and permutation,
+	// so the sampler's location comes out of the bound program's reflection table
+	constexpr uint32_t AlbedoMapUniform = HashUniformName( "albedoMap" );
+
+	// Uniforms stay with the program, no need to set it again
+	// if the same program is still bound
+	if ( gStateCache.GetProgram() != lastProgram )
 	{
-		textureUniformHandle = shader->GetUniformHandle( "albedoMap" );
+		shader->SetUniform1i( AlbedoMapUniform, 0 );
 	}
-	shader->SetUniform1i( textureUniformHandle, 0 );
 	// -------------------------------------
 
-	// Set up the matrices
-	// TODO: Set up the projection and view matrices at the start of the frame?
-	SetupMatrices( params, shader );
+	return shader;
+}
 
-	// Bind the VA so we know what we're supposed to render
-	va.Bind();
+// =====================================================================
+// Renderer_OpenGL45::GetSurfaceGeometry
+// =====================================================================
+SurfaceGeometry Renderer_OpenGL45::GetSurfaceGeometry( const RenderModelHandle& model, const int& surface )
+{
+	// Surfaces of all models share the same VAO, so they can go into the same multi-draw
+	const VertexArray& va = vertexArrays[model].at( surface );
+	return { va.GetFirstIndex(), uint32_t( va.GetNumIndices() ), va.GetBaseVertex(), va.GetHandle() };
+}
 
-	// Also bind an instanced array
-	if ( batchSize > BatchSizeThreshold )
+// =====================================================================
+// Renderer_OpenGL45::RenderIndirect
+// =====================================================================
+void Renderer_OpenGL45::RenderIndirect( const DrawIndirectList& list )
+{
+	if ( list.commands.empty() )
 	{
-		InstancedArray& ia = instancedArrays[batchHandle];
-		ia.Bind();
-		ia.SetupVertexAttributes();
+		return;
 	}
 
-	// GPU, RENDER NOW!
-	PerformDrawCall( va, batchSize );
+	const uint32_t commandBytes = list.commands.size() * sizeof( DrawElementsIndirectCommand );
+	const uint32_t drawDataBytes = list.drawData.size() * sizeof( DrawData );
 
-	CanErrorPrint = true;
+	uint32_t commandOffset = 0U;
+	uint32_t drawDataOffset = 0U;
+	void* commandMemory = streamBuffer.Allocate( commandBytes, sizeof( uint32_t ), commandOffset );
+	void* drawDataMemory = streamBuffer.Allocate( drawDataBytes, storageBufferAlignment, drawDataOffset );
+
+	if ( nullptr != commandMemory && nullptr != drawDataMemory )
+	{
+		memcpy( commandMemory, list.commands.data(), commandBytes );
+		memcpy( drawDataMemory, list.drawData.data(), drawDataBytes );
+
+		gStateCache.BindBuffer( GL_DRAW_INDIRECT_BUFFER, streamBuffer.GetBuffer() );
+		gStateCache.BindBufferRange( GL_SHADER_STORAGE_BUFFER, StorageBufferBindings::DrawData, streamBuffer.GetBuffer(), drawDataOffset, drawDataBytes );
+	}
+	else
+	{	// Too much for the stream buffer this frame, respecifying
+		// the whole thing orphans last frame's data at least
+		glNamedBufferData( indirectCommandBuffer, commandBytes, list.commands.data(), GL_STREAM_DRAW );
+		glNamedBufferData( drawDataBuffer, drawDataBytes, list.drawData.data(), GL_STREAM_DRAW );
+		commandOffset = 0U;
+
+		gStateCache.BindBuffer( GL_DRAW_INDIRECT_BUFFER, indirectCommandBuffer );
+		gStateCache.BindBufferBase( GL_SHADER_STORAGE_BUFFER, StorageBufferBindings::DrawData, drawDataBuffer );
+	}
+	numStreamBytesUploaded += commandBytes + drawDataBytes;
+
+	for ( const DrawIndirectBucket& bucket : list.buckets )
+	{
+		VertexArray& va = vertexArrays[bucket.model].at( bucket.surface );
+		BindMaterial( va.GetMaterial(), ShaderFlag_Normal | ShaderFlag_Indirect );
+		va.Bind();
+
+		const size_t bucketOffset = commandOffset + bucket.firstCommand * sizeof( DrawElementsIndirectCommand );
+		glMultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, VertexArray::VBOffset( bucketOffset ), bucket.numCommands, 0 );
+
+		numDrawCalls++;
+		for ( uint32_t i = bucket.firstCommand; i < bucket.firstCommand + bucket.numCommands; i++ )
+		{
+			numDrawnTriangles += (list.commands[i].count / 3) * list.commands[i].instanceCount;
+		}
+	}
 }
 
 // =====================================================================
@@ -233,6 +515,22 @@ void Renderer_OpenGL45::RenderSurfaceBatch( const RenderEntityParams& params, co
 void Renderer_OpenGL45::SetRenderView( const RenderView* view )
 {
 	currentView = *view;
+
+	// Get the projection matrix going
+	float width = currentView.viewportWidth, height = currentView.viewportHeight;
+	viewUniforms.projMatrix = glm::perspective(
+		glm::radians( currentView.cameraFov ), // camera FOV
+		width / height, // aspect ratio
+		0.01f, // zMin
+		8192.0f ); // zFar
+
+	// Set the view matrix, ultimately
+	viewUniforms.viewMatrix = glm::translate( currentView.cameraOrientation, currentView.cameraPosition );
+	viewUniforms.viewProjMatrix = viewUniforms.projMatrix * viewUniforms.viewMatrix;
+
+	glNamedBufferSubData( viewUniformBuffer, 0, sizeof( ViewUniforms ), &viewUniforms );
+	numStreamBytesUploaded += sizeof( ViewUniforms );
+	gStateCache.BindBufferBase( GL_UNIFORM_BUFFER, UniformBlockBindings::View, viewUniformBuffer );
 }
 
 // =====================================================================
@@ -265,33 +563,95 @@ void Renderer_OpenGL45::CopyFrameToTexture( ITexture* texture )
 // =====================================================================
 RenderModelHandle Renderer_OpenGL45::CreateModel( const RenderModelParams& params, const DrawMesh* model )
 {
-	// Generate a vertex buffer from the mesh
-	vertexBuffers.push_back( VertexBuffer() );
-	VertexBuffer& vb = vertexBuffers.back();
-	
-	// Step 1: populate the vertex buffer with data
-	vb.Init( model );
-	GLError( "generated a vertex buffer" );
-
-	// Step 2: for every surface in the model, create a vertex array
-	// with this vertex buffer
-	vertexArrays.push_back( VertexArrayGroup() );
-	VertexArrayGroup& vag = vertexArrays.back();
-	for ( const DrawSurface& surface : model->surfaces )
+	VertexArrayGroup vag;
+	if ( !AddModelGeometry( vag, model ) )
 	{
-		vag.push_back( VertexArray( &vb, &surface ) );
-		GLError( "generated a vertex array" );
+		return RenderHandleInvalid;
 	}
 
-	return RenderHandleInvalid;
+	vertexArrays.push_back( std::move( vag ) );
+	return vertexArrays.size() - 1U;
 }
 
 // =====================================================================
 // Renderer_OpenGL45::UpdateModel
 // =====================================================================
-void Renderer_OpenGL45::UpdateModel( const RenderModelHandle& handle, const DrawMesh* model )
+bool Renderer_OpenGL45::UpdateModel( const RenderModelHandle& handle, const DrawMesh* model )
+{
+	if ( handle >= vertexArrays.size() || nullptr == model )
+	{
+		return false;
+	}
+
+	// The new geometry goes in first, so the model keeps the old one if it doesn't fit
+	VertexArrayGroup vag;
+	if ( !AddModelGeometry( vag, model ) )
+	{
+		return false;
+	}
+
+	// Give the old geometry back, the holes get filled by
+	// new models or by defragmentation at the end of a frame
+	FreeModelGeometry( vertexArrays[handle] );
+	vertexArrays[handle] = std::move( vag );
+	return true;
+}
+
+// =====================================================================
+// Renderer_OpenGL45::AddModelGeometry
+// =====================================================================
+bool Renderer_OpenGL45::AddModelGeometry( VertexArrayGroup& vag, const DrawMesh* model )
+{
+	// Step 1: put the mesh's vertices into the shared vertex buffer
+	const ArenaRange vertexRange = staticGeometry.AddVertices( model );
+	GLError( "uploaded the model's vertices" );
+	if ( vertexRange == ArenaRangeInvalid && !model->vertices.empty() )
+	{
+		printf( "Renderer: no room for %u vertices in the geometry buffer\n", uint32_t( model->vertices.size() ) );
+		return false;
+	}
+
+	// Step 2: for every surface in the model, put its indices
+	// into the shared index buffer
+	for ( const DrawSurface& surface : model->surfaces )
+	{
+		vag.push_back( VertexArray( &staticGeometry, vertexRange, &surface ) );
+
+		// Empty surfaces are fine, they just draw nothing
+		if ( vag.back().GetNumIndices() != surface.vertexIndices.size() )
+		{
+			printf( "Renderer: no room for %u indices in the geometry buffer\n", uint32_t( surface.vertexIndices.size() ) );
+			FreeModelGeometry( vag );
+			return false;
+		}
+	}
+
+	// Nothing refers to the vertices then
+	if ( vag.empty() )
+	{
+		staticGeometry.FreeVertices( vertexRange );
+	}
+
+	return true;
+}
+
+// =====================================================================
+// Renderer_OpenGL45::FreeModelGeometry
+// =====================================================================
+void Renderer_OpenGL45::FreeModelGeometry( VertexArrayGroup& vag )
 {
+	// The vertices are shared by all surfaces of the model
+	if ( !vag.empty() )
+	{
+		staticGeometry.FreeVertices( vag.front().GetVertexRange() );
+	}
 
+	for ( VertexArray& va : vag )
+	{
+		va.FreeIndices();
+	}
+
+	vag.clear();
 }
 
 // =====================================================================
@@ -316,36 +676,101 @@ void Renderer_OpenGL45::UpdateTexture( ITexture* texture, byte* data )
 // =====================================================================
 // Renderer_OpenGL45::CreateBatch
 // =====================================================================
-BatchHandle Renderer_OpenGL45::CreateBatch( RenderBatchParam* params, const int& batchSize )
+BatchHandle Renderer_OpenGL45::CreateBatch( const void* params, const uint32_t& batchSize, const BatchFormat& format )
 {
 	if ( nullptr == params || batchSize <= BatchSizeThreshold )
 	{
 		return BatchInvalid;
 	}
 
-	instancedArrays.push_back( InstancedArray( params, batchSize ) );
-	InstancedArray& ia = instancedArrays.back();
-
+	InstancedArray ia = (format == BatchFormat_Compact)
+		? InstancedArray( &compactInstanceArena, &streamBuffer, InstanceLayout_Compact, params, batchSize )
+		: InstancedArray( &instanceArena, &streamBuffer, InstanceLayout_Matrix, params, batchSize );
 	if ( !ia.IsValid() )
 	{
 		return BatchInvalid;
 	}
 
+	if ( !freeBatches.empty() )
+	{
+		const BatchHandle handle = freeBatches.back();
+		freeBatches.pop_back();
+		instancedArrays[handle] = std::move( ia );
+		return handle;
+	}
+
+	// BatchInvalid itself can't be handed out
+	if ( instancedArrays.size() >= BatchInvalid )
+	{
+		ia.Release();
+		return BatchInvalid;
+	}
+
+	instancedArrays.push_back( std::move( ia ) );
 	return instancedArrays.size() - 1;
 }
 
 // =====================================================================
 // Renderer_OpenGL45::UpdateBatch
 // =====================================================================
-void Renderer_OpenGL45::UpdateBatch( const BatchHandle& handle, RenderBatchParam* params, const int& batchSize )
+bool Renderer_OpenGL45::UpdateBatch( const BatchHandle& handle, const void* params, const uint32_t& first, const uint32_t& count )
 {
 	if ( !IsBatchValid( handle ) )
 	{
-		return;
+		return false;
 	}
 
 	InstancedArray& ia = instancedArrays[handle];
-	ia.Update( params, batchSize );
+	const bool wasDirty = ia.IsDirty();
+	if ( !ia.Update( params, first, count ) )
+	{
+		return false;
+	}
+
+	if ( !wasDirty )
+	{
+		dirtyBatches.push_back( handle );
+	}
+
+	return true;
+}
+
+// =====================================================================
+// Renderer_OpenGL45::DestroyBatch
+// =====================================================================
+void Renderer_OpenGL45::DestroyBatch( const BatchHandle& handle )
+{
+	if ( !IsBatchValid( handle ) )
+	{
+		return;
+	}
+
+	instancedArrays[handle].Release();
+	freeBatches.push_back( handle );
+}
+
+// =====================================================================
+// Renderer_OpenGL45::FlushDirtyBatches
+// =====================================================================
+void Renderer_OpenGL45::FlushDirtyBatches()
+{
+	for ( const BatchHandle& handle : dirtyBatches )
+	{
+		// Destroyed, or already flushed through an earlier entry of the same slot
+		InstancedArray& ia = instancedArrays[handle];
+		if ( !ia.IsDirty() )
+		{
+			continue;
+		}
+
+		const uint32_t fullBytes = ia.GetBatchSize() * GetInstanceStride( ia.GetLayout() );
+		const uint32_t uploadedBytes = ia.Flush();
+
+		numBatchBytesUploaded += uploadedBytes;
+		numBatchBytesSaved += fullBytes - uploadedBytes;
+	}
+
+	dirtyBatches.clear();
 }
 
 // =====================================================================
@@ -365,6 +790,47 @@ bool Renderer_OpenGL45::IsBatchValid( const BatchHandle& handle )
 	return true;
 }
 
+// =====================================================================
+// Renderer_OpenGL45::GetBatchSize
+// =====================================================================
+uint32_t Renderer_OpenGL45::GetBatchSize( const BatchHandle& handle )
+{
+	if ( !IsBatchValid( handle ) )
+	{
+		return 0U;
+	}
+
+	return instancedArrays[handle].GetBatchSize();
+}
+
+// =====================================================================
+// Renderer_OpenGL45::GetBatchFormat
+// =====================================================================
+BatchFormat Renderer_OpenGL45::GetBatchFormat( const BatchHandle& handle )
+{
+	if ( IsBatchValid( handle ) && instancedArrays[handle].GetLayout() == InstanceLayout_Compact )
+	{
+		return BatchFormat_Compact;
+	}
+
+	return BatchFormat_Matrix;
+}
+
+// =====================================================================
+// Renderer_OpenGL45::GetArenaStats
+// =====================================================================
+GpuArenaStats Renderer_OpenGL45::GetArenaStats( const GpuArena& arena ) const
+{
+	switch ( arena )
+	{
+	case GpuArena_Vertices: return staticGeometry.GetVertices().GetStats();
+	case GpuArena_Indices: return staticGeometry.GetIndices().GetStats();
+	case GpuArena_Instances: return instanceArena.GetStats();
+	case GpuArena_CompactInstances: return compactInstanceArena.GetStats();
+	default: return GpuArenaStats();
+	}
+}
+
 // =====================================================================
 // Renderer_OpenGL45::InitDefaultShader
 // =====================================================================
@@ -375,10 +841,11 @@ bool Renderer_OpenGL45::InitDefaultShader()
 		printf( "Error in filesystem: %s\n", defaultShader.GetErrorMessage() );
 		return false;
 	}
-	// Compile the shader
-	if ( !defaultShader.Compile() )
+	// Compile the shader, and wait for it, since it's the fallback for all the others
+	if ( !defaultShader.Compile() || !defaultShader.WaitForCompile() )
 	{
-		printf( "Error in compilation: %s\n", defaultShader.GetErrorMessage() );
+		// The driver's log is printed as soon as a permutation fails, see Shader::CheckCompileStatus
+		printf( "Error in compilation: '%s' is unusable\n", defaultShader.GetName() );
 		return false;
 	}
 
@@ -394,56 +861,32 @@ void Renderer_OpenGL45::BindDefaultShader()
 }
 
 // =====================================================================
-// Renderer_OpenGL45::SetupMatrices
+// Renderer_OpenGL45::SetupModelMatrix
 // =====================================================================
-void Renderer_OpenGL45::SetupMatrices( const RenderEntityParams& params, IShader* shader )
+void Renderer_OpenGL45::SetupModelMatrix( const glm::mat4* modelMatrix, IShader* shader )
 {
-	// TODO: calculate proj matrix at the start of the frame
-	// 
-	// Get the projection matrix going
-	float width = currentView.viewportWidth, height = currentView.viewportHeight;
-	const glm::mat4 projectionMatrix = glm::perspective(
-		glm::radians( currentView.cameraFov ), // camera FOV
-		width / height, // aspect ratio
-		0.01f, // zMin
-		8192.0f ); // zFar
-
-	shader->SetProjectionMatrix( projectionMatrix );
-
-	// TODO: calculate model matrices in the render entity, and if it's
-	// a static prop, do not update it
-	// 
-	// Calculate the model matrix
-	const glm::vec3& position = params.position;
-	const glm::mat4& axis = params.orientation; // orientation contains angles & scale
-	// Move the model then rotate
-	glm::mat4 modelMatrix = glm::translate( glm::identity<glm::mat4>(), position );
-	modelMatrix *= axis;
-
-	// Set the model matrix
-	shader->SetModelMatrix( modelMatrix );
-
-	// TODO: calculate the view matrix at the start of the frame
-	// 
-	// Set the view matrix, ultimately
-	glm::mat4 viewMatrix = currentView.cameraOrientation;
-	viewMatrix = glm::translate( viewMatrix, currentView.cameraPosition );
+	// Instanced draws get their model matrices from the instance data,
+	// everything else gets the one the render entity has cached
+	if ( nullptr == modelMatrix )
+	{
+		return;
+	}
 
-	shader->SetViewMatrix( viewMatrix );
+	shader->SetModelMatrix( *modelMatrix );
 }
 
 // =====================================================================
 // Renderer_OpenGL45::PerformDrawCall
 // =====================================================================
-void Renderer_OpenGL45::PerformDrawCall( VertexArray& va, const uint32_t& batchSize )
+void Renderer_OpenGL45::PerformDrawCall( VertexArray& va, const uint32_t& batchSize, const uint32_t& baseInstance )
 {
 	if ( batchSize > BatchSizeThreshold )
 	{
-		glDrawElementsInstanced( GL_TRIANGLES, va.GetNumIndices(), GL_UNSIGNED_INT, nullptr, batchSize );
+		glDrawElementsInstancedBaseVertexBaseInstance( GL_TRIANGLES, va.GetNumIndices(), GL_UNSIGNED_INT, va.GetIndexOffset(), batchSize, va.GetBaseVertex(), baseInstance );
 	}
 	else
 	{
-		glDrawElements( GL_TRIANGLES, va.GetNumIndices(), GL_UNSIGNED_INT, nullptr );
+		glDrawElementsBaseVertex( GL_TRIANGLES, va.GetNumIndices(), GL_UNSIGNED_INT, va.GetIndexOffset(), va.GetBaseVertex() );
 	}
 
 	numDrawCalls++;
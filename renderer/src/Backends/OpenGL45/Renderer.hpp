@@ -3,7 +3,6 @@
 #include <unordered_map>
 
 class Model;
-class VertexBuffer;
 
 // =====================================================================
 // OpenGL 4.5 render backend
@@ -31,12 +30,31 @@ public:
     void                ReloadShaders() override;
 
     // Renders multiple DrawSurface instances, is still equivalent to 1 drawcall (depending on the backend)
-    // @param params: render entity parameters, to position and rotate the model in space, among other things
+    // @param model: handle of the model to render
+    // @param modelMatrix: the render entity's world matrix
     // @param surface: surface ID, must not be bigger than the number of surfaces in a model
     // @param batchHandle: handle to the backend batch object
     // @param batchSize: how many instances to draw
-    void                RenderSurfaceBatch( const RenderEntityParams& params, const int& surface,
+    void                RenderSurfaceBatch( const RenderModelHandle& model, const glm::mat4& modelMatrix, const int& surface,
                                             const BatchHandle& batchHandle, const int& batchSize ) override;
+    // Reserves memory in the stream buffer for instances that are only drawn this frame
+    // @param outFirstInstance: pass this on to RenderSurfaceInstances
+    // @returns nullptr if there's no room left this frame
+    RenderBatchParam*   AllocateTransientInstances( const uint32_t& numInstances, uint32_t& outFirstInstance ) override;
+    // Renders a surface once for every instance, in 1 drawcall
+    // @param model: handle of the model to render
+    // @param surface: surface ID, must not be bigger than the number of surfaces in a model
+    // @param firstInstance: from AllocateTransientInstances
+    // @param numInstances: how many instances to draw
+    void                RenderSurfaceInstances( const RenderModelHandle& model, const int& surface,
+                                                const uint32_t& firstInstance, const int& numInstances ) override;
+
+    // @returns Whether RenderIndirect can be used at all
+    bool                SupportsIndirectDrawing() const override { return indirectSupported; }
+    // @returns Where the surface's indices and vertices are, for indirect commands
+    SurfaceGeometry     GetSurfaceGeometry( const RenderModelHandle& model, const int& surface ) override;
+    // Uploads the commands and per-draw data, then renders each bucket with one multi-draw call
+    void                RenderIndirect( const DrawIndirectList& list ) override;
 
     // Set the render view, update the viewport etc.
     void                SetRenderView( const RenderView* view ) override;
@@ -49,43 +67,134 @@ public:
     void                CopyFrameToTexture( ITexture* texture ) override;
 
     // Creates a model from given parameters
+    // @returns RenderHandleInvalid if its geometry doesn't fit
     RenderModelHandle   CreateModel( const RenderModelParams& params, const DrawMesh* model ) override;
     // Updates a model, only for dynamic models
-    void                UpdateModel( const RenderModelHandle& handle, const DrawMesh* model ) override;
+    // @returns false if the new geometry doesn't fit, the model keeps the old one then
+    bool                UpdateModel( const RenderModelHandle& handle, const DrawMesh* model ) override;
 
     // Creates a texture from given data
     ITexture*           AllocateTexture( const char* name ) override;
     // Updates a texture with new data
     void                UpdateTexture( ITexture* texture, byte* data ) override;
 
-    // Registers a render batch so a render entity can be rendered in multiple instances
-    BatchHandle         CreateBatch( RenderBatchParam* params, const int& batchSize ) override;
-    // Updates data for this render batch
-    void                UpdateBatch( const BatchHandle& handle, RenderBatchParam* params, const int& batchSize ) override;
+    // Copies the params into a new render batch, so render entities can be rendered in multiple instances
+    BatchHandle         CreateBatch( const void* params, const uint32_t& batchSize, const BatchFormat& format ) override;
+    // Copies params into instances [first, first + count) of the batch, they are uploaded in the next BeginFrame
+    // @returns false if the batch had to grow and there's no room for it
+    bool                UpdateBatch( const BatchHandle& handle, const void* params, const uint32_t& first, const uint32_t& count ) override;
+    // Frees the batch and its handle for reuse
+    void                DestroyBatch( const BatchHandle& handle ) override;
     // Checks if the handle and the batch at the handle are valid
     bool                IsBatchValid( const BatchHandle& handle ) override;
+    // @returns How many instances the batch has
+    uint32_t            GetBatchSize( const BatchHandle& handle ) override;
+    // @returns What the batch is made of
+    BatchFormat         GetBatchFormat( const BatchHandle& handle ) override;
+
+    // @returns Memory usage and fragmentation of a GPU buffer arena
+    GpuArenaStats       GetArenaStats( const GpuArena& arena ) const override;
+    // Fills in the draw, triangle, state change and upload counters of the last frame
+    void                GetFrameCounters( FrameStats& stats ) const override;
+    // Reads back the oldest timer query, if the GPU is done with it
+    bool                GetGpuFrameTime( uint64_t& frameNumber, float& milliseconds ) override;
 
 private:
+    using VertexArrayGroup = std::vector<VertexArray>;
+
     bool                InitDefaultShader();
     void                BindDefaultShader();
 
-    void                SetupMatrices( const RenderEntityParams& params, IShader* shader );
-    void                PerformDrawCall( VertexArray& va, const uint32_t& batchSize = 0 );
+    // Binds the material's shader permutation and textures
+    // @returns The bound shader
+    IShader*            BindMaterial( IMaterial* material, const uint16_t& shaderFlags );
+    // Binds the surface's material and vertex array, then draws it
+    // @param modelMatrix: can be nullptr for instanced draws
+    // @param layout: format of the instance data, if numInstances is above BatchSizeThreshold
+    // @param instanceBuffer: buffer with the instance data
+    // @param baseInstance: where the instances start in instanceBuffer
+    void                DrawVertexArray( VertexArray& va, const glm::mat4* modelMatrix, const InstanceLayout& layout,
+                                         const uint32_t& instanceBuffer, const uint32_t& baseInstance, const uint32_t& numInstances );
+    // Sets the model matrix, the rest comes from the view uniform buffer
+    void                SetupModelMatrix( const glm::mat4* modelMatrix, IShader* shader );
+    void                PerformDrawCall( VertexArray& va, const uint32_t& batchSize = 0, const uint32_t& baseInstance = 0 );
+    // Puts the mesh into the geometry buffer, one vertex array per surface
+    // @returns false if it doesn't fit, vag is left empty then
+    bool                AddModelGeometry( VertexArrayGroup& vag, const DrawMesh* model );
+    // Gives the vertices and indices of all surfaces back to the geometry buffer, and clears vag
+    void                FreeModelGeometry( VertexArrayGroup& vag );
+    // Uploads the dirty ranges of all batches changed since the last frame
+    void                FlushDirtyBatches();
 
 private:
-    using VertexArrayGroup = std::vector<VertexArray>;
-
     std::vector<VertexArrayGroup> vertexArrays;
-    std::vector<VertexBuffer> vertexBuffers;
+    // Vertices and indices of all models, there's only one vertex format so far
+    GeometryBuffer      staticGeometry;
     std::vector<InstancedArray> instancedArrays;
+    // Instance data of all batches, drawn with a base instance
+    // Compact batches have their own arena, since the arenas work in whole elements
+    BufferArena         instanceArena;
+    BufferArena         compactInstanceArena;
+    // Batches with dirty ranges waiting to be uploaded
+    std::vector<BatchHandle> dirtyBatches;
+    // Slots of destroyed batches, reused by CreateBatch
+    std::vector<BatchHandle> freeBatches;
+    // Persistently mapped, for everything that's written every frame:
+    // transient instances, indirect commands, per-draw data and batch uploads
+    RingBuffer          streamBuffer;
+    // GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+    uint32_t            storageBufferAlignment{ 256U };
     
     RenderView          currentView;
+    // Projection, view and view-projection matrices of currentView
+    ViewUniforms        viewUniforms;
+    // Holds viewUniforms, bound to UniformBlockBindings::View
+    uint32_t            viewUniformBuffer{ 0 };
+
+    // Needs GL_ARB_shader_draw_parameters for gl_BaseInstanceARB
+    bool                indirectSupported{ false };
+    // DrawElementsIndirectCommands and DrawData for RenderIndirect,
+    // only used if they don't fit into the stream buffer
+    uint32_t            indirectCommandBuffer{ 0 };
+    uint32_t            drawDataBuffer{ 0 };
 
     Shader              defaultShader;
 
+    // Starting capacity of instanceArena and compactInstanceArena
+    static constexpr uint32_t InitialInstances = 1U << 16U;
+    // How much data each arena can move around per frame while defragmenting
+    static constexpr uint32_t DefragmentBytesPerFrame = 1U << 20U;
+    // Size of each of the stream buffer's regions
+    static constexpr uint32_t StreamBufferFrameSize = 8U << 20U;
+
 private: // Statistics
     uint32_t            numDrawCalls;
     uint32_t            numDrawnTriangles;
+    // Batch data uploaded by FlushDirtyBatches, and what would've
+    // been uploaded on top of that if whole batches were re-uploaded
+    uint32_t            numBatchBytesUploaded;
+    uint32_t            numBatchBytesSaved;
+    // Everything else written into the stream buffer or the view uniform buffer
+    uint32_t            numStreamBytesUploaded;
+    // The stream buffer counts its stalls from the start, this is where the frame began
+    uint32_t            numStreamBufferStalls;
+
+    // GL_TIME_ELAPSED around each frame. The GPU is a frame or two behind,
+    // so each query has NumTimerQueries frames to finish before it's reused
+    struct TimerQuery
+    {
+        uint32_t        query{ 0 };
+        uint64_t        frameNumber{ 0U };
+        // Ended, but the result wasn't read yet
+        bool            pending{ false };
+    };
+
+    static constexpr uint32_t NumTimerQueries = 4U;
+    std::array<TimerQuery, NumTimerQueries> timerQueries;
+    // Counts BeginFrames
+    uint64_t            frameNumber{ 0U };
+    // This frame is being timed, it isn't if its query was still pending
+    bool                timingFrame{ false };
 };
 
 /*
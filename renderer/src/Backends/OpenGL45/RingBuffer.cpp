@@ -0,0 +1,136 @@
+#include "IRenderWorld.hpp"
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include "RingBuffer.hpp"
+#include "StateCache.hpp"
+#include "DebugOutput.hpp"
+
+// =====================================================================
+// RingBuffer::Init
+// =====================================================================
+void RingBuffer::Init( const uint32_t& newRegionSize )
+{
+	regionSize = newRegionSize;
+	currentRegion = 0U;
+	regionOffset = 0U;
+	numStalls = 0U;
+
+	// Coherent, so there's no need to flush anything we write
+	constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const size_t totalSize = size_t( regionSize ) * FramesInFlight;
+
+	glCreateBuffers( 1, &buffer );
+	glNamedBufferStorage( buffer, totalSize, nullptr, flags );
+	mappedMemory = static_cast<uint8_t*>( glMapNamedBufferRange( buffer, 0, totalSize, flags ) );
+	GLError( "RingBuffer::Init: created and mapped the ring buffer" );
+}
+
+// =====================================================================
+// RingBuffer::Shutdown
+// =====================================================================
+void RingBuffer::Shutdown()
+{
+	if ( !buffer )
+	{
+		return;
+	}
+
+	for ( void*& fence : fences )
+	{
+		if ( nullptr != fence )
+		{
+			glDeleteSync( static_cast<GLsync>( fence ) );
+			fence = nullptr;
+		}
+	}
+
+	glUnmapNamedBuffer( buffer );
+	glDeleteBuffers( 1, &buffer );
+	gStateCache.ForgetBuffer( buffer );
+
+	buffer = 0U;
+	mappedMemory = nullptr;
+}
+
+// =====================================================================
+// RingBuffer::NextFrame
+// =====================================================================
+void RingBuffer::NextFrame()
+{
+	fences[currentRegion] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+
+	currentRegion = (currentRegion + 1U) % FramesInFlight;
+	regionOffset = 0U;
+
+	GLsync fence = static_cast<GLsync>( fences[currentRegion] );
+	if ( nullptr == fence )
+	{
+		return;
+	}
+
+	// Most of the time, the GPU is long done with it
+	GLenum result = glClientWaitSync( fence, 0, 0 );
+	if ( result == GL_TIMEOUT_EXPIRED )
+	{
+		numStalls++;
+
+		// Flush, otherwise the fence may never even reach the GPU
+		constexpr GLuint64 OneSecond = 1000000000U;
+		do
+		{
+			result = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, OneSecond );
+		} while ( result == GL_TIMEOUT_EXPIRED );
+	}
+
+	glDeleteSync( fence );
+	fences[currentRegion] = nullptr;
+}
+
+// =====================================================================
+// RingBuffer::Allocate
+// =====================================================================
+void* RingBuffer::Allocate( const uint32_t& size, const uint32_t& alignment, uint32_t& outOffset )
+{
+	if ( nullptr == mappedMemory )
+	{
+		return nullptr;
+	}
+
+	// Alignment doesn't have to be a power of two, e.g. sizeof( DrawData )
+	const uint32_t regionStart = currentRegion * regionSize;
+	uint32_t offset = regionStart + regionOffset;
+	if ( alignment > 1U && offset % alignment )
+	{
+		offset += alignment - offset % alignment;
+	}
+
+	if ( offset + size > regionStart + regionSize )
+	{
+		return nullptr;
+	}
+
+	regionOffset = offset + size - regionStart;
+	outOffset = offset;
+	return mappedMemory + offset;
+}
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
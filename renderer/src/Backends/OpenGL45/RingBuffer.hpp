@@ -0,0 +1,66 @@
+#pragma once
+
+// =====================================================================
+// RingBuffer
+// 
+// A buffer that stays mapped for its whole lifetime, split into one
+// region per frame in flight. Data for the GPU is written straight into
+// the mapped memory, the driver never has to copy or synchronise anything.
+// 
+// Instead, each region gets a fence once its frame has been submitted,
+// and before the CPU writes into it again, NextFrame waits for that fence.
+// Anything allocated is valid until the end of the current frame.
+// =====================================================================
+class RingBuffer final
+{
+public:
+	static constexpr uint32_t FramesInFlight = 3U;
+
+	// @param regionSize: how much can be allocated per frame, in bytes
+	void		Init( const uint32_t& regionSize );
+	void		Shutdown();
+
+	// Fences the current region and moves onto the next one,
+	// waiting for the GPU if it's still reading from it
+	void		NextFrame();
+
+	// @param outOffset: where the memory is within GetBuffer
+	// @returns Mapped memory to write into, nullptr if the region is full
+	void*		Allocate( const uint32_t& size, const uint32_t& alignment, uint32_t& outOffset );
+
+	uint32_t	GetBuffer() const { return buffer; }
+	// @returns How many times NextFrame had to wait for the GPU
+	uint32_t	GetNumStalls() const { return numStalls; }
+
+private:
+	uint32_t	buffer{ 0U };
+	uint8_t*	mappedMemory{ nullptr };
+	uint32_t	regionSize{ 0U };
+
+	uint32_t	currentRegion{ 0U };
+	// Offset of the next allocation within the current region
+	uint32_t	regionOffset{ 0U };
+	// GLsync objects
+	void*		fences[FramesInFlight]{};
+
+	uint32_t	numStalls{ 0U };
+};
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -1,7 +1,13 @@
 #include "IRenderWorld.hpp"
 #include "Shader.hpp"
+#include "StateCache.hpp"
+#include "ProgramCache.hpp"
+#include "ShaderPreprocessor.hpp"
 
 #include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
 
 #define GLEW_STATIC 1
 #include <GL/glew.h>
@@ -19,136 +25,379 @@ bool Shader::Load( const char* shaderPath )
 		return false;
 	}
 
+	// Reads the file and the ones it includes, unless they haven't changed since last time
+	// It goes into a copy, so the shader stays as it was if an edit broke it, see Reload
+	PreprocessedShader processed = source;
+	if ( !gShaderPreprocessor.Process( shaderPath, processed, errorMessage ) )
+	{
+		return false;
+	}
+
 	fileName = shaderPath;
 	name = shaderPath;
 
-	std::ifstream shaderFile( shaderPath );
-	if ( shaderFile.bad() || shaderFile.eof() )
+	// Every edit while hot reloading makes new sections, the old ones aren't needed anymore
+	if ( source.vertexHash && source.vertexHash != processed.vertexHash )
 	{
-		errorMessage = 
-			std::string( "Shader '" )
-			.append( shaderPath )
-			.append( "' is bad or empty" );
-		return false;
+		gShaderPreprocessor.ReleaseStageTexts( source.vertexHash );
+	}
+	if ( source.fragmentHash && source.fragmentHash != processed.fragmentHash )
+	{
+		gShaderPreprocessor.ReleaseStageTexts( source.fragmentHash );
 	}
 
-	supportedShaderFlags = ExtractShaderMeta( shaderFile, versionText );
-	PopulateShaderObjects();
+	source = std::move( processed );
 
-	vertexText = ExtractShaderText( "vertex", shaderFile );
-	fragmentText = ExtractShaderText( "fragment", shaderFile );
+	supportedShaderFlags = source.supportedShaderFlags;
+	PopulateShaderObjects();
 
+	errorMessage.clear();
 	return true;
 }
 
+bool Shader::canPollCompletion = false;
+
+bool Shader::recordUsage = true;
+
 bool Shader::Compile()
 {
+	const auto startTime = std::chrono::steady_clock::now();
+	const uint32_t startHits = gProgramCache.GetNumHits();
+
+	// Only what the game used last time, everything is submitted first and checked
+	// only later, so the driver can compile them in parallel in the meantime
+	LoadUsageList();
+
+	int numSubmitted = 0;
 	for ( ShaderObject& object : apiObjects )
 	{
-		// Create everything
-		object.shaderHandle = glCreateProgram();
-		object.vertexShader = glCreateShader( GL_VERTEX_SHADER );
-		object.fragmentShader = glCreateShader( GL_FRAGMENT_SHADER );
+		if ( std::find( usedFlags.begin(), usedFlags.end(), object.shaderFlags ) != usedFlags.end() )
+		{
+			SubmitObject( object );
+			numSubmitted++;
+		}
+	}
+
+	const auto endTime = std::chrono::steady_clock::now();
+	const float milliseconds = std::chrono::duration<float, std::milli>( endTime - startTime ).count();
+	printf( "Shader '%s': submitted %i of %i permutations in %.2f ms, %i from the program cache\n",
+			name.c_str(), numSubmitted, static_cast<int>( apiObjects.size() ), milliseconds,
+			static_cast<int>( gProgramCache.GetNumHits() - startHits ) );
+
+	return true;
+}
+
+void Shader::SubmitObject( ShaderObject& object )
+{
+	object.shaderHandle = glCreateProgram();
+
+	// The exact same program may have been linked on a previous run, in which
+	// case its source doesn't even need to be put together
+	object.cacheKey = gProgramCache.MakeKey( source.vertexHash, source.fragmentHash, object.shaderFlags );
+	if ( gProgramCache.Load( object.shaderHandle, object.cacheKey ) )
+	{
+		object.vertexShader = 0;
+		object.fragmentShader = 0;
+		object.state = ShaderObject::State_Ready;
+		FindUniforms( object );
+		return;
+	}
+
+	// GLSL preprocessor defines for shader permutations go between the version and the code
+	const std::string& finalVertexText = gShaderPreprocessor.GetStageText(
+		source.versionText, source.vertexText, source.vertexHash, object.shaderFlags );
+	const std::string& finalFragmentText = gShaderPreprocessor.GetStageText(
+		source.versionText, source.fragmentText, source.fragmentHash, object.shaderFlags );
+
+	object.vertexShader = glCreateShader( GL_VERTEX_SHADER );
+	object.fragmentShader = glCreateShader( GL_FRAGMENT_SHADER );
+
+	// Load the shaders with code
+	const char* vertexString = finalVertexText.c_str();
+	const char* fragmentString = finalFragmentText.c_str();
 
-		// Determine GLSL preprocessor defines for shader permutations
-		// versionText goes FIRST and foremost, then defines, then the
-		// actual shader code
-		std::string preprocessorText = versionText + DeterminePreprocessorFlags( object.shaderFlags );
-		std::string finalVertexText = preprocessorText + vertexText;
-		std::string finalFragmentText = preprocessorText + fragmentText;
+	glShaderSource( object.vertexShader, 1, &vertexString, nullptr );
+	glShaderSource( object.fragmentShader, 1, &fragmentString, nullptr );
 
-		// Load the shaders with code
-		const char* vertexString = finalVertexText.c_str();
-		const char* fragmentString = finalFragmentText.c_str();
+	// Compile the shaders, attach them & link, the status is checked later
+	glCompileShader( object.vertexShader );
+	glCompileShader( object.fragmentShader );
+
+	glAttachShader( object.shaderHandle, object.vertexShader );
+	glAttachShader( object.shaderHandle, object.fragmentShader );
+	if ( gProgramCache.IsEnabled() )
+	{
+		glProgramParameteri( object.shaderHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+	}
+	glLinkProgram( object.shaderHandle );
 
-		printf( "## VERTEX SHADER STRING:\n%s\n", vertexString );
+	object.state = ShaderObject::State_Compiling;
+}
 
-		glShaderSource( object.vertexShader, 1, &vertexString, nullptr );
-		glShaderSource( object.fragmentShader, 1, &fragmentString, nullptr );
+bool Shader::IsReady( uint16_t shaderFlags )
+{
+	ShaderObject* object = FindObject( shaderFlags );
+	if ( nullptr == object )
+	{
+		return false;
+	}
 
-		// Compile the shaders
-		glCompileShader( object.vertexShader );
-		glCompileShader( object.fragmentShader );
+	return CheckCompileStatus( *object, false );
+}
 
-		currentObject = &object;
-		const char* errorMessage = GetErrorMessage();
-		if ( nullptr != errorMessage )
+bool Shader::WaitForCompile()
+{
+	const auto startTime = std::chrono::steady_clock::now();
+
+	bool success = true;
+	for ( ShaderObject& object : apiObjects )
+	{
+		if ( object.state != ShaderObject::State_NotCompiled )
 		{
-			printf( "Error while compiling: %s\n", errorMessage );
-			return false;
+			success &= CheckCompileStatus( object, true );
+		}
+	}
+
+	const auto endTime = std::chrono::steady_clock::now();
+	const float milliseconds = std::chrono::duration<float, std::milli>( endTime - startTime ).count();
+	printf( "Shader '%s': waited %.2f ms for the driver to finish\n", name.c_str(), milliseconds );
+
+	return success;
+}
+
+bool Shader::WaitForCompile( uint16_t shaderFlags )
+{
+	ShaderObject* object = FindObject( shaderFlags );
+	if ( nullptr == object )
+	{
+		return false;
+	}
+
+	return CheckCompileStatus( *object, true );
+}
+
+ShaderObject* Shader::FindObject( uint16_t shaderFlags )
+{
+	for ( ShaderObject& object : apiObjects )
+	{
+		if ( object.shaderFlags == shaderFlags )
+		{
+			return &object;
 		}
+	}
 
-		// Attach shaders & link
-		glAttachShader( object.shaderHandle, object.vertexShader );
-		glAttachShader( object.shaderHandle, object.fragmentShader );
-		glLinkProgram( object.shaderHandle );
+	return nullptr;
+}
 
-		errorMessage = GetLinkerErrorMessage();
-		if ( nullptr != errorMessage )
+bool Shader::CheckCompileStatus( ShaderObject& object, const bool& wait )
+{
+	// First time anyone asked for this one
+	if ( object.state == ShaderObject::State_NotCompiled )
+	{
+		SubmitObject( object );
+		RecordUsage( object.shaderFlags );
+	}
+
+	if ( object.state != ShaderObject::State_Compiling )
+	{
+		return object.state == ShaderObject::State_Ready;
+	}
+
+	// Without parallel compilation, asking for the status blocks anyway
+	if ( !wait && canPollCompletion )
+	{
+		GLint completed = GL_FALSE;
+		glGetProgramiv( object.shaderHandle, GL_COMPLETION_STATUS_KHR, &completed );
+		if ( !completed )
 		{
-			printf( "Error while linking: %s\n", errorMessage );
 			return false;
 		}
+	}
 
-		// Delete these shader objects, we dun need them any more
-		glDeleteShader( object.vertexShader );
-		glDeleteShader( object.fragmentShader );
+	currentObject = &object;
+	const char* errorMessage = GetCompileErrorMessage( object );
+	if ( nullptr != errorMessage )
+	{
+		printf( "Error while compiling '%s': %s\n", name.c_str(), errorMessage );
+	}
+	else if ( nullptr != (errorMessage = GetLinkerErrorMessage()) )
+	{
+		printf( "Error while linking '%s': %s\n", name.c_str(), errorMessage );
+	}
 
-		// Get some uniform handles
-		object.uniformProjectionMatrix = GetUniformHandle( "projMatrix" );
-		object.uniformModelMatrix = GetUniformHandle( "modelMatrix" );
-		object.uniformViewMatrix = GetUniformHandle( "viewMatrix" );
+	// Delete these shader objects, we dun need them any more
+	glDeleteShader( object.vertexShader );
+	glDeleteShader( object.fragmentShader );
+	object.vertexShader = 0;
+	object.fragmentShader = 0;
+
+	if ( nullptr != errorMessage )
+	{
+		object.state = ShaderObject::State_Failed;
+		return false;
 	}
 
+	gProgramCache.Store( object.shaderHandle, object.cacheKey );
+	FindUniforms( object );
+	object.state = ShaderObject::State_Ready;
 	return true;
 }
 
-void Shader::Reload()
+void Shader::FindUniforms( ShaderObject& object )
 {
-	for ( ShaderObject& object : apiObjects )
+	currentObject = &object;
+	object.uniforms.clear();
+	object.uniformBlocks.clear();
+
+	constexpr int MaxNameLength = 256;
+	char resourceName[MaxNameLength];
+
+	// Uniforms in the default block, the ones inside of blocks don't have a location
+	GLint numUniforms = 0;
+	glGetProgramInterfaceiv( object.shaderHandle, GL_UNIFORM, GL_ACTIVE_RESOURCES, &numUniforms );
+	for ( GLint i = 0; i < numUniforms; i++ )
 	{
-		glDeleteProgram( object.shaderHandle );
+		constexpr GLenum Properties[] = { GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+		GLint values[4];
+		glGetProgramResourceiv( object.shaderHandle, GL_UNIFORM, i, 4, Properties, 4, nullptr, values );
+		if ( values[3] != -1 || values[1] < 0 )
+		{
+			continue;
+		}
+
+		glGetProgramResourceName( object.shaderHandle, GL_UNIFORM, i, MaxNameLength, nullptr, resourceName );
+		// Arrays show up as name[0], their handle is the plain name though
+		if ( char* bracket = strchr( resourceName, '[' ) )
+		{
+			*bracket = '\0';
+		}
+
+		object.uniforms.push_back( { HashUniformName( resourceName ), values[1], static_cast<uint32_t>( values[0] ), values[2] } );
 	}
 
-	Load( fileName.c_str() );
-	Compile();
+	std::sort( object.uniforms.begin(), object.uniforms.end(),
+		[]( const ShaderUniform& a, const ShaderUniform& b ) { return a.nameHash < b.nameHash; } );
+
+	GLint numBlocks = 0;
+	glGetProgramInterfaceiv( object.shaderHandle, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &numBlocks );
+	for ( GLint i = 0; i < numBlocks; i++ )
+	{
+		constexpr GLenum Properties[] = { GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+		GLint values[2];
+		glGetProgramResourceiv( object.shaderHandle, GL_UNIFORM_BLOCK, i, 2, Properties, 2, nullptr, values );
+		glGetProgramResourceName( object.shaderHandle, GL_UNIFORM_BLOCK, i, MaxNameLength, nullptr, resourceName );
+
+		object.uniformBlocks.push_back( { HashUniformName( resourceName ), static_cast<uint32_t>( i ), values[0], values[1] } );
+	}
+
+	// Shaders that don't specify a binding for the view block still
+	// need it at the same binding point as everyone else
+	constexpr uint32_t ViewDataHash = HashUniformName( "ViewData" );
+	const ShaderUniformBlock* viewBlock = object.FindUniformBlock( ViewDataHash );
+	if ( nullptr != viewBlock && viewBlock->binding != UniformBlockBindings::View )
+	{
+		glUniformBlockBinding( object.shaderHandle, viewBlock->index, UniformBlockBindings::View );
+	}
+
+	// Get some uniform handles
+	object.uniformProjectionMatrix = object.GetUniformLocation( HashUniformName( "projMatrix" ) );
+	object.uniformModelMatrix = object.GetUniformLocation( HashUniformName( "modelMatrix" ) );
+	object.uniformViewMatrix = object.GetUniformLocation( HashUniformName( "viewMatrix" ) );
 }
 
-void Shader::Bind( uint16_t shaderFlags )
+bool Shader::Reload()
 {
-	if ( !((supportedShaderFlags & shaderFlags) ^ shaderFlags) )
+	// Read everything again, a file can change without its write time
+	// changing, if the file system only stores it in whole seconds
+	for ( const std::string& dependency : source.dependencies )
+	{
+		gShaderPreprocessor.Invalidate( dependency );
+	}
+
+	// Load starts over with new permutations, the old ones are kept around
+	// until it's known to have worked, and put back if it didn't
+	std::vector<ShaderObject> oldObjects = std::move( apiObjects );
+	apiObjects.clear();
+	if ( !Load( fileName.c_str() ) )
+	{
+		apiObjects = std::move( oldObjects );
+		return false;
+	}
+
+	for ( ShaderObject& object : oldObjects )
 	{
-		for ( ShaderObject& object : apiObjects )
+		// Never used, so there's nothing to delete
+		if ( object.state == ShaderObject::State_NotCompiled )
 		{
-			if ( object.shaderFlags == shaderFlags )
-			{
-				glUseProgram( object.shaderHandle );
-				currentObject = &object;
-				return;
-			}
+			continue;
+		}
+
+		if ( object.state == ShaderObject::State_Compiling )
+		{
+			glDeleteShader( object.vertexShader );
+			glDeleteShader( object.fragmentShader );
 		}
+
+		gStateCache.ForgetProgram( object.shaderHandle );
+		glDeleteProgram( object.shaderHandle );
+	}
+
+	return Compile();
+}
+
+void Shader::Bind( uint16_t shaderFlags )
+{
+	// Permutations that are still compiling can't be drawn with yet
+	ShaderObject* object = FindObject( shaderFlags );
+	if ( nullptr != object && CheckCompileStatus( *object, false ) )
+	{
+		gStateCache.UseProgram( object->shaderHandle );
+		currentObject = object;
+		return;
 	}
 	
-	glUseProgram( 0 );
+	gStateCache.UseProgram( 0 );
 }
 
 const char* Shader::GetErrorMessage() const
+{
+	// The files couldn't be read or preprocessed, so GL never got to see anything
+	if ( !errorMessage.empty() )
+	{
+		return errorMessage.c_str();
+	}
+
+	if ( nullptr == currentObject )
+	{
+		return nullptr;
+	}
+
+	return GetCompileErrorMessage( *currentObject );
+}
+
+const char* Shader::GetCompileErrorMessage( const ShaderObject& object ) const
 {
 	int success;
 	static char infoLog[512];
 
+	// The shader objects are gone once the permutation has been checked
+	if ( !object.vertexShader || !object.fragmentShader )
+	{
+		return nullptr;
+	}
+
 	// Check the vertex shader
-	glGetShaderiv( currentObject->vertexShader, GL_COMPILE_STATUS, &success );
+	glGetShaderiv( object.vertexShader, GL_COMPILE_STATUS, &success );
 	if ( !success )
 	{
-		glGetShaderInfoLog( currentObject->vertexShader, 512, nullptr, infoLog );
+		glGetShaderInfoLog( object.vertexShader, 512, nullptr, infoLog );
 		return infoLog;
 	}
 	// Then the fragment shader
-	glGetShaderiv( currentObject->fragmentShader, GL_COMPILE_STATUS, &success );
+	glGetShaderiv( object.fragmentShader, GL_COMPILE_STATUS, &success );
 	if ( !success )
 	{
-		glGetShaderInfoLog( currentObject->fragmentShader, 512, nullptr, infoLog );
+		glGetShaderInfoLog( object.fragmentShader, 512, nullptr, infoLog );
 		return infoLog;
 	}
 
@@ -160,6 +409,11 @@ const char* Shader::GetLinkerErrorMessage() const
 	int success;
 	static char infoLog[512];
 
+	if ( nullptr == currentObject )
+	{
+		return nullptr;
+	}
+
 	glGetProgramiv( currentObject->shaderHandle, GL_LINK_STATUS, &success );
 	if ( !success )
 	{
@@ -170,44 +424,112 @@ const char* Shader::GetLinkerErrorMessage() const
 	return nullptr;
 }
 
+void Shader::RecordUsage( uint16_t shaderFlags )
+{
+	if ( std::find( usedFlags.begin(), usedFlags.end(), shaderFlags ) != usedFlags.end() )
+	{
+		return;
+	}
+
+	usedFlags.push_back( shaderFlags );
+	if ( recordUsage )
+	{
+		SaveUsageList();
+	}
+}
+
+void Shader::LoadUsageList()
+{
+	usedFlags.clear();
+
+	std::ifstream file( fileName + ".usage" );
+	std::string line;
+	while ( std::getline( file, line ) )
+	{
+		// Comments
+		if ( line.empty() || line[0] == '#' )
+		{
+			continue;
+		}
+
+		const unsigned long shaderFlags = std::strtoul( line.c_str(), nullptr, 0 );
+		if ( shaderFlags && shaderFlags < ShaderFlag_MAX && SupportsFlags( shaderFlags ) )
+		{
+			usedFlags.push_back( shaderFlags );
+		}
+	}
+}
+
+void Shader::SaveUsageList() const
+{
+	if ( fileName.empty() )
+	{
+		return;
+	}
+
+	std::ofstream file( fileName + ".usage", std::ios::trunc );
+	file << "# Shader permutations the game used, compiled when the shader is loaded" << std::endl;
+	for ( const uint16_t& shaderFlags : usedFlags )
+	{
+		char line[16];
+		snprintf( line, sizeof( line ), "0x%04x", shaderFlags );
+		file << line << std::endl;
+	}
+}
+
 uint32_t Shader::GetUniformHandle( const char* uniformName ) const
 {
-	return glGetUniformLocation( currentObject->shaderHandle, uniformName );
+	return HashUniformName( uniformName );
+}
+
+void Shader::SetProjectionMatrix( const glm::mat4& m )
+{
+	glUniformMatrix4fv( currentObject->uniformProjectionMatrix, 1, GL_FALSE, &m[0].x );
+}
+
+void Shader::SetModelMatrix( const glm::mat4& m )
+{
+	glUniformMatrix4fv( currentObject->uniformModelMatrix, 1, GL_FALSE, &m[0].x );
+}
+
+void Shader::SetViewMatrix( const glm::mat4& m )
+{
+	glUniformMatrix4fv( currentObject->uniformViewMatrix, 1, GL_FALSE, &m[0].x );
 }
 
 void Shader::SetUniform1i( const uint32_t& uniformHandle, const int& value )
 {
-	glUniform1i( uniformHandle, value );
+	glUniform1i( currentObject->GetUniformLocation( uniformHandle ), value );
 }
 
 void Shader::SetUniform1f( const uint32_t& uniformHandle, const float& value )
 {
-	glUniform1f( uniformHandle, value );
+	glUniform1f( currentObject->GetUniformLocation( uniformHandle ), value );
 }
 
 void Shader::SetUniform2f( const uint32_t& uniformHandle, const float& x, const float& y )
 {
-	glUniform2f( uniformHandle, x, y );
+	glUniform2f( currentObject->GetUniformLocation( uniformHandle ), x, y );
 }
 
 void Shader::SetUniform3f( const uint32_t& uniformHandle, const float& x, const float& y, const float& z )
 {
-	glUniform3f( uniformHandle, x, y, z );
+	glUniform3f( currentObject->GetUniformLocation( uniformHandle ), x, y, z );
 }
 
 void Shader::SetUniform3fv( const uint32_t& uniformHandle, const glm::vec3& v )
 {
-	glUniform3fv( uniformHandle, 1, &v.x );
+	glUniform3fv( currentObject->GetUniformLocation( uniformHandle ), 1, &v.x );
 }
 
 void Shader::SetUniformmat3( const uint32_t& uniformHandle, const glm::mat3& m )
 {
-	glUniformMatrix3fv( uniformHandle, 1, GL_FALSE, &m[0].x );
+	glUniformMatrix3fv( currentObject->GetUniformLocation( uniformHandle ), 1, GL_FALSE, &m[0].x );
 }
 
 void Shader::SetUniformmat4( const uint32_t& uniformHandle, const glm::mat4& m )
 {
-	glUniformMatrix4fv( uniformHandle, 1, GL_FALSE, &m[0].x );
+	glUniformMatrix4fv( currentObject->GetUniformLocation( uniformHandle ), 1, GL_FALSE, &m[0].x );
 }
 
 constexpr uint16_t ShaderFlagCombinations[] =
@@ -215,12 +537,17 @@ constexpr uint16_t ShaderFlagCombinations[] =
 	ShaderFlag_Normal,
 	ShaderFlag_Normal | ShaderFlag_Instanced,
 	ShaderFlag_Normal | ShaderFlag_CanSkin,
-	ShaderFlag_Normal | ShaderFlag_Instanced | ShaderFlag_CanSkin
+	ShaderFlag_Normal | ShaderFlag_Instanced | ShaderFlag_CanSkin,
+	ShaderFlag_Normal | ShaderFlag_Indirect,
+	ShaderFlag_Normal | ShaderFlag_Instanced | ShaderFlag_CompactInstanced
 };
 
 void Shader::PopulateShaderObjects()
 {
 	ShaderObject object;
+	// Reloading loads the shader again, the old permutations are gone by then
+	apiObjects.clear();
+	currentObject = nullptr;
 
 	for ( const uint16_t& flagCombo : ShaderFlagCombinations )
 	{
@@ -240,102 +567,6 @@ void Shader::PopulateShaderObjects()
 	}
 }
 
-uint16_t Shader::ExtractShaderMeta( std::ifstream& file, std::string& versionText )
-{
-	uint16_t shaderFlags = ShaderFlag_Normal;
-	std::string token;
-
-	// Record where we were, so we can return to this once done
-	auto lastSeekPoint = file.tellg();
-	
-	// Go to the start of the file
-	file.clear();
-	file.seekg( 0, std::ios::beg );
-
-	while ( file >> token )
-	{
-		if ( token == "#supports" )
-		{
-			file >> token;
-			if ( token == "instancing" || token == "batching" )
-			{
-				shaderFlags |= ShaderFlag_Instanced;
-			}
-		}
-
-		if ( token == "#version" )
-		{
-			std::getline( file, token );
-			versionText = "#version " + token + "\n";
-		}
-	}
-
-	// Go back
-	file.seekg( lastSeekPoint );
-	return shaderFlags;
-}
-
-std::string Shader::ExtractShaderText( const char* sectionName, std::ifstream& file )
-{
-	std::ostringstream textStream; // all the shader text for this section
-	bool entered = false; // whether we entered our section or not
-	std::string line; // the current line in the text file
-
-	// Record where we were
-	auto lastSeekPoint = file.tellg();
-	
-	// Seek back to the start
-	file.clear(); // clear EOF flag
-	file.seekg( 0, std::ios::beg );
-	
-	while ( std::getline( file, line ) )
-	{
-		// Skip any FoxGLBox-specific keywords
-		if ( line.find( "#supports" ) != std::string::npos )
-		{
-			continue;
-		}
-
-		// Find #section sectionName
-		if ( !entered && (line.find( "#section" ) != std::string::npos) )
-		{
-			if ( line.find( sectionName, line.find( "#section" ) ) != std::string::npos )
-			{
-				entered = true;
-			}
-
-			continue;
-		}
-		// If we're in a section and we find an end, we get out
-		if ( entered && (line.find( "#endsection" ) != std::string::npos) )
-		{
-			entered = false;
-			break;
-		}
-		// Parse everything in there basically
-		// TODO: add #include...
-		if ( entered )
-		{
-			textStream << line << std::endl;
-		}
-	}
-
-	// Put it back
-	file.seekg( lastSeekPoint );
-
-	return textStream.str();
-}
-
-std::string Shader::DeterminePreprocessorFlags( uint16_t shaderFlags )
-{
-	std::string result = "\n";
-
-	if ( shaderFlags & ShaderFlag_Instanced )
-		result += "#define SHADER_INSTANCED 1\n";
-
-	return result;
-}
-
 /*
 Copyright (c) 2021 Admer456
 
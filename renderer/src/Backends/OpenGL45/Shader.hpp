@@ -2,17 +2,120 @@
 
 #include <string>
 #include <fstream>
+#include <vector>
+#include <algorithm>
+
+#include "ShaderPreprocessor.hpp"
+
+// Fixed binding points of uniform blocks, shared by all shader programs
+// These must match the binding layout qualifiers in the shaders
+struct UniformBlockBindings
+{
+	// ViewData: projMatrix, viewMatrix, viewProjMatrix
+	static constexpr int View = 0;
+};
+
+// Fixed binding points of shader storage blocks
+struct StorageBufferBindings
+{
+	// DrawDataBuffer: DrawData for each instance of each indirect command
+	static constexpr int DrawData = 0;
+};
+
+// std140 layout of the ViewData uniform block
+struct ViewUniforms
+{
+	glm::mat4		projMatrix;
+	glm::mat4		viewMatrix;
+	glm::mat4		viewProjMatrix;
+};
+
+// @returns The 32-bit FNV-1a hash of a uniform or block name, which is also its handle
+constexpr uint32_t HashUniformName( const char* name )
+{
+	uint32_t hash = 2166136261U;
+	for ( ; *name; name++ )
+	{
+		hash ^= static_cast<uint8_t>( *name );
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+// An active uniform outside of any block, found when the program was linked
+struct ShaderUniform
+{
+	uint32_t		nameHash;
+	int32_t			location;
+	// GL_FLOAT_MAT4, GL_SAMPLER_2D etc.
+	uint32_t		type;
+	int32_t			arraySize;
+};
+
+// An active uniform block
+struct ShaderUniformBlock
+{
+	uint32_t		nameHash;
+	uint32_t		index;
+	int32_t			binding;
+	int32_t			dataSize;
+};
 
 class ShaderObject final
 {
 public:
+	// @returns The uniform's location, -1 if the program doesn't have it
+	int32_t			GetUniformLocation( const uint32_t& nameHash ) const
+	{
+		// Sorted by hash, and only a handful of entries, no need for anything fancier
+		auto iter = std::lower_bound( uniforms.begin(), uniforms.end(), nameHash,
+			[]( const ShaderUniform& uniform, const uint32_t& hash ) { return uniform.nameHash < hash; } );
+
+		return (iter != uniforms.end() && iter->nameHash == nameHash) ? iter->location : -1;
+	}
+
+	// @returns The block, nullptr if the program doesn't have it
+	const ShaderUniformBlock* FindUniformBlock( const uint32_t& nameHash ) const
+	{
+		for ( const ShaderUniformBlock& block : uniformBlocks )
+		{
+			if ( block.nameHash == nameHash )
+			{
+				return &block;
+			}
+		}
+
+		return nullptr;
+	}
+
+	enum State : uint8_t
+	{
+		// Nothing asked for it yet, it gets compiled the first time it's bound
+		State_NotCompiled,
+		// Submitted to the driver, which may still be compiling and linking it
+		State_Compiling,
+		// Linked, can be bound
+		State_Ready,
+		// Didn't compile or link, see the log
+		State_Failed
+	};
+
 	uint32_t		vertexShader;
 	uint32_t		fragmentShader;
 	uint32_t		shaderHandle;
+	State			state{ State_NotCompiled };
+	// See ProgramCache::MakeKey
+	uint64_t		cacheKey{ 0U };
+
+	// Reflection tables, sorted by name hash
+	std::vector<ShaderUniform> uniforms;
+	std::vector<ShaderUniformBlock> uniformBlocks;
 
-	uint32_t		uniformProjectionMatrix;
-	uint32_t		uniformModelMatrix;
-	uint32_t		uniformViewMatrix;
+	// Locations of the uniforms that are set for every draw
+	int32_t			uniformProjectionMatrix{ -1 };
+	int32_t			uniformModelMatrix{ -1 };
+	int32_t			uniformViewMatrix{ -1 };
 
 	uint16_t		shaderFlags;
 };
@@ -32,17 +135,40 @@ public:
 	// @param shaderPath: path to the shader
 	// @returns: false if the file cannot be found
 	bool				Load( const char* shaderPath ) override;
-	// Build the shader
+	// Submits the permutations from the shader's usage list to the driver, without waiting for
+	// any of them. The rest are compiled the first time they're asked for, see IsReady
+	// Errors only show up once a permutation is checked, see IsReady and WaitForCompile
 	// @returns true on success, false if there was an error
 	bool				Compile() override;
-	// Reloads the shader
-	void				Reload();
+	// @returns Whether the permutation for these flags is linked and can be bound
+	// Submits it if it hasn't been yet, but doesn't wait for it, unless the driver
+	// can't tell if it's still compiling
+	bool				IsReady( uint16_t shaderFlags ) override;
+	// Waits for every submitted permutation to be compiled and linked
+	// @returns false if any of them failed
+	bool				WaitForCompile();
+	// Compiles the permutation for these flags if needed, and waits for it
+	// @returns false if it failed, or the shader doesn't support these flags
+	bool				WaitForCompile( uint16_t shaderFlags );
+	// Reads the shader's files again and resubmits its permutations
+	// @returns false if they can't be loaded, the old permutations stay then, see GetErrorMessage
+	bool				Reload() override;
 	// Binds the shader to be used for rendering
 	void				Bind( uint16_t shaderFlags ) override;
-	// @returns The error message, in case there was one while compiling
+	// @returns Whether this shader has a permutation for all of the given flags
+	bool				SupportsFlags( uint16_t shaderFlags ) const override
+	{
+		return !((supportedShaderFlags & shaderFlags) ^ shaderFlags);
+	}
+	// @returns The error message, in case there was one while loading or compiling
+	// Load errors, like a missing include, take precedence, nullptr if there was none
 	const char*			GetErrorMessage() const override;
 	// @returns The linker error message done during glLinkProgram
 	const char*			GetLinkerErrorMessage() const;
+	// @returns How many files the shader is made of, the shader file and everything it includes
+	uint32_t			GetNumDependencies() const override { return source.dependencies.size(); }
+	// @returns The absolute path to one of them, see FileWatcher::NormalisePath
+	const char*			GetDependency( uint32_t index ) const override { return source.dependencies.at( index ).c_str(); }
 
 	// Uniforms //
 	uint32_t			GetUniformHandle( const char* uniformName ) const override;
@@ -54,47 +180,59 @@ public:
 	void				SetUniformmat3( const uint32_t& uniformHandle, const glm::mat3& m ) override;
 	void				SetUniformmat4( const uint32_t& uniformHandle, const glm::mat4& m ) override;
 
-	void				SetProjectionMatrix( const glm::mat4& m ) override
-	{
-		SetUniformmat4( currentObject->uniformProjectionMatrix, m );
-	}
-
-	void				SetModelMatrix( const glm::mat4& m ) override
-	{
-		SetUniformmat4( currentObject->uniformModelMatrix, m );
-	}
-	
-	void				SetViewMatrix( const glm::mat4& m ) override
-	{
-		SetUniformmat4( currentObject->uniformViewMatrix, m );
-	}
+	// These go straight to the locations found when the program was linked
+	void				SetProjectionMatrix( const glm::mat4& m ) override;
+	void				SetModelMatrix( const glm::mat4& m ) override;
+	void				SetViewMatrix( const glm::mat4& m ) override;
 
 private:
+	// @returns The permutation with exactly these flags, nullptr if there is none
+	ShaderObject*		FindObject( uint16_t shaderFlags );
+	// @returns The driver's compile log of the permutation, nullptr if it compiled
+	// or its shader objects were already deleted
+	const char*			GetCompileErrorMessage( const ShaderObject& object ) const;
+	// Hands the permutation's source over to the driver to compile and link
+	void				SubmitObject( ShaderObject& object );
+	// Adds the permutation to the usage list, and saves the list if it's new in there
+	void				RecordUsage( uint16_t shaderFlags );
+	// The usage list is kept next to the shader file, as <shader>.usage
+	void				LoadUsageList();
+	void				SaveUsageList() const;
+	// Checks the compile and link status of a submitted permutation, and finishes it up
+	// @param wait: block until the driver is done with it
+	// @returns true if the permutation is ready
+	bool				CheckCompileStatus( ShaderObject& object, const bool& wait );
+	// Fills the reflection tables of a linked program, and binds its uniform blocks
+	void				FindUniforms( ShaderObject& object );
+
 	// Populates apiObjects with ShaderObjects
 	// The resulting number of apiObjects will be the number of
 	// unique shader flag combinations
 	void				PopulateShaderObjects();
 
-	// Parses shader metadata, sets versionText
-	// @returns value for supportedShaderFlags
-	static uint16_t		ExtractShaderMeta( std::ifstream& file, std::string& versionText );
-	static std::string	ExtractShaderText( const char* sectionName, std::ifstream& file );
-	static std::string	DeterminePreprocessorFlags( uint16_t shaderFlags );
-
 private:
 	std::string			name{ "Default" };
 	std::string			fileName{ "" };
-	std::string			errorMessage{ "OK" };
+	// Why the last Load failed, empty if it didn't
+	std::string			errorMessage{};
 
-	std::string			versionText{ "#version 450 core\n" };
-	std::string			vertexText;
-	std::string			fragmentText;
+	// Expanded sections, their hashes, and the files they came from
+	PreprocessedShader	source;
 
 	// ShaderObject stores permutated shader handles
 	std::vector<ShaderObject> apiObjects;
-	ShaderObject*		currentObject;
+	// Flags of the permutations the game actually used, precompiled by Compile
+	std::vector<uint16_t> usedFlags;
+	ShaderObject*		currentObject{ nullptr };
 
 	uint16_t			supportedShaderFlags{ ShaderFlag_Normal };
+
+public:
+	// Set if the driver has KHR/ARB_parallel_shader_compile, in which case
+	// it can be asked whether a program is done without waiting for it
+	static bool			canPollCompletion;
+	// Set if newly used permutations should be written into the usage lists
+	static bool			recordUsage;
 };
 
 /*
@@ -0,0 +1,331 @@
+#include "IRenderWorld.hpp"
+#include "ShaderPreprocessor.hpp"
+#include "ProgramCache.hpp"
+#include "FileWatcher.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+namespace fs = std::filesystem;
+
+ShaderPreprocessor gShaderPreprocessor;
+
+// @returns Whether the directive starts the line, followed by whitespace or nothing
+static bool IsDirective( const std::string& line, const size_t& start, const char* directive )
+{
+	const size_t length = strlen( directive );
+	if ( line.compare( start, length, directive ) )
+	{
+		return false;
+	}
+
+	return start + length == line.size() || isspace( static_cast<unsigned char>( line[start + length] ) );
+}
+
+// @returns The first word after position
+static std::string NextWord( const std::string& line, const size_t& position )
+{
+	const size_t start = line.find_first_not_of( " \t\r", position );
+	if ( start == std::string::npos )
+	{
+		return "";
+	}
+
+	const size_t end = line.find_first_of( " \t\r", start );
+	return line.substr( start, end == std::string::npos ? std::string::npos : end - start );
+}
+
+// =====================================================================
+// ShaderPreprocessor::Process
+// =====================================================================
+bool ShaderPreprocessor::Process( const char* shaderPath, PreprocessedShader& result, std::string& errorMessage )
+{
+	const std::string path = FileWatcher::NormalisePath( shaderPath );
+	const SourceFile* file = GetFile( path, errorMessage );
+	if ( nullptr == file )
+	{
+		return false;
+	}
+
+	if ( !file->versionText.empty() )
+	{
+		result.versionText = file->versionText;
+	}
+	result.supportedShaderFlags = file->supportedShaderFlags;
+	result.vertexText.clear();
+	result.fragmentText.clear();
+	result.dependencies.clear();
+
+	// Both sections include the same files most of the time, but not always
+	std::vector<std::string> included;
+	if ( !Expand( path, "vertex", result.vertexText, included, errorMessage ) )
+	{
+		return false;
+	}
+	result.dependencies = included;
+
+	included.clear();
+	if ( !Expand( path, "fragment", result.fragmentText, included, errorMessage ) )
+	{
+		return false;
+	}
+
+	for ( const std::string& dependency : included )
+	{
+		if ( std::find( result.dependencies.begin(), result.dependencies.end(), dependency ) == result.dependencies.end() )
+		{
+			result.dependencies.push_back( dependency );
+		}
+	}
+
+	const uint64_t versionHash = ProgramCache::Hash( result.versionText.data(), result.versionText.size() );
+	result.vertexHash = ProgramCache::Hash( result.vertexText.data(), result.vertexText.size(), versionHash );
+	result.fragmentHash = ProgramCache::Hash( result.fragmentText.data(), result.fragmentText.size(), versionHash );
+
+	return true;
+}
+
+// =====================================================================
+// ShaderPreprocessor::GetStageText
+// =====================================================================
+const std::string& ShaderPreprocessor::GetStageText( const std::string& versionText, const std::string& sectionText,
+													 const uint64_t& sectionHash, const uint16_t& shaderFlags )
+{
+	std::unordered_map<uint16_t, std::string>& permutations = stageTexts[sectionHash];
+
+	auto iter = permutations.find( shaderFlags );
+	if ( iter != permutations.end() )
+	{
+		return iter->second;
+	}
+
+	// versionText goes FIRST and foremost, then defines, then the
+	// actual shader code
+	return permutations[shaderFlags] = versionText + DeterminePreprocessorFlags( shaderFlags ) + sectionText;
+}
+
+// =====================================================================
+// ShaderPreprocessor::ReleaseStageTexts
+// =====================================================================
+void ShaderPreprocessor::ReleaseStageTexts( const uint64_t& sectionHash )
+{
+	stageTexts.erase( sectionHash );
+}
+
+// =====================================================================
+// ShaderPreprocessor::Invalidate
+// =====================================================================
+void ShaderPreprocessor::Invalidate( const std::string& path )
+{
+	files.erase( FileWatcher::NormalisePath( path ) );
+}
+
+// =====================================================================
+// ShaderPreprocessor::DeterminePreprocessorFlags
+// =====================================================================
+std::string ShaderPreprocessor::DeterminePreprocessorFlags( uint16_t shaderFlags )
+{
+	std::string result = "\n";
+
+	if ( shaderFlags & ShaderFlag_Instanced )
+		result += "#define SHADER_INSTANCED 1\n";
+
+	if ( shaderFlags & ShaderFlag_Indirect )
+		result += "#define SHADER_INDIRECT 1\n";
+
+	if ( shaderFlags & ShaderFlag_CompactInstanced )
+		result += "#define SHADER_COMPACT_INSTANCED 1\n";
+
+	return result;
+}
+
+// =====================================================================
+// ShaderPreprocessor::GetFile
+// =====================================================================
+const ShaderPreprocessor::SourceFile* ShaderPreprocessor::GetFile( const std::string& path, std::string& errorMessage )
+{
+	std::error_code error;
+	const fs::file_time_type writeTime = fs::last_write_time( path, error );
+	if ( error )
+	{
+		errorMessage = 
+			std::string( "Shader file '" )
+			.append( path )
+			.append( "' does not exist" );
+		files.erase( path );
+		return nullptr;
+	}
+
+	auto iter = files.find( path );
+	if ( iter != files.end() && iter->second.writeTime == writeTime )
+	{
+		return &iter->second;
+	}
+
+	SourceFile file;
+	file.writeTime = writeTime;
+	if ( !ReadFile( path, file, errorMessage ) )
+	{
+		files.erase( path );
+		return nullptr;
+	}
+
+	SourceFile& result = files[path];
+	result = std::move( file );
+	return &result;
+}
+
+// =====================================================================
+// ShaderPreprocessor::ReadFile
+// =====================================================================
+bool ShaderPreprocessor::ReadFile( const std::string& path, SourceFile& file, std::string& errorMessage )
+{
+	std::ifstream stream( path );
+	if ( !stream )
+	{
+		errorMessage = 
+			std::string( "Shader file '" )
+			.append( path )
+			.append( "' cannot be opened" );
+		return false;
+	}
+
+	const fs::path directory = fs::path( path ).parent_path();
+	std::string section;
+	std::string line;
+
+	while ( std::getline( stream, line ) )
+	{
+		const size_t start = line.find_first_not_of( " \t" );
+		if ( start != std::string::npos && line[start] == '#' )
+		{
+			// FoxGLBox-specific keywords
+			if ( IsDirective( line, start, "#supports" ) )
+			{
+				const std::string feature = NextWord( line, start + 9 );
+				if ( feature == "instancing" || feature == "batching" )
+				{
+					file.supportedShaderFlags |= ShaderFlag_Instanced;
+				}
+				else if ( feature == "indirect" )
+				{
+					file.supportedShaderFlags |= ShaderFlag_Indirect;
+				}
+				else if ( feature == "compactinstancing" )
+				{
+					file.supportedShaderFlags |= ShaderFlag_CompactInstanced;
+				}
+				continue;
+			}
+
+			// Goes before the defines, so it's kept separately
+			if ( IsDirective( line, start, "#version" ) )
+			{
+				file.versionText = line.substr( start ) + "\n";
+				continue;
+			}
+
+			if ( IsDirective( line, start, "#section" ) )
+			{
+				section = NextWord( line, start + 8 );
+				continue;
+			}
+
+			if ( IsDirective( line, start, "#endsection" ) )
+			{
+				section.clear();
+				continue;
+			}
+
+			if ( IsDirective( line, start, "#include" ) )
+			{
+				const size_t nameStart = line.find( '"', start );
+				const size_t nameEnd = nameStart == std::string::npos ? nameStart : line.find( '"', nameStart + 1 );
+				if ( nameEnd == std::string::npos )
+				{
+					errorMessage = 
+						std::string( "Shader file '" )
+						.append( path )
+						.append( "' has a malformed #include: " )
+						.append( line );
+					return false;
+				}
+
+				const fs::path includePath = directory / line.substr( nameStart + 1, nameEnd - nameStart - 1 );
+				file.chunks.push_back( { section, "", FileWatcher::NormalisePath( includePath.string() ) } );
+				continue;
+			}
+		}
+
+		// Consecutive lines of the same section go into the same chunk
+		if ( file.chunks.empty() || !file.chunks.back().includePath.empty() || file.chunks.back().section != section )
+		{
+			file.chunks.push_back( { section, "", "" } );
+		}
+
+		file.chunks.back().text.append( line ).append( "\n" );
+	}
+
+	return true;
+}
+
+// =====================================================================
+// ShaderPreprocessor::Expand
+// =====================================================================
+bool ShaderPreprocessor::Expand( const std::string& path, const std::string& section, std::string& text,
+								 std::vector<std::string>& included, std::string& errorMessage )
+{
+	// Every file goes in once, which also stops files from including each other forever
+	if ( std::find( included.begin(), included.end(), path ) != included.end() )
+	{
+		return true;
+	}
+	included.push_back( path );
+
+	const SourceFile* file = GetFile( path, errorMessage );
+	if ( nullptr == file )
+	{
+		return false;
+	}
+
+	for ( const Chunk& chunk : file->chunks )
+	{
+		if ( chunk.section != section )
+		{
+			continue;
+		}
+
+		if ( chunk.includePath.empty() )
+		{
+			text += chunk.text;
+		}
+		else if ( !Expand( chunk.includePath, "", text, included, errorMessage ) )
+		{
+			errorMessage.append( ", included from '" ).append( path ).append( "'" );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
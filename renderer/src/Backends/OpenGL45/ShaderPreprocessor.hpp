@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+
+// A shader file with all of its includes expanded, split into its sections
+struct PreprocessedShader
+{
+	// The #version line, goes before everything else, even the defines
+	std::string		versionText{ "#version 450 core\n" };
+	std::string		vertexText;
+	std::string		fragmentText;
+	// Hashes of the version line and each expanded section
+	uint64_t		vertexHash{ 0U };
+	uint64_t		fragmentHash{ 0U };
+	// From the #supports lines
+	uint16_t		supportedShaderFlags{ ShaderFlag_Normal };
+	// The shader file and every file it includes, directly or not
+	std::vector<std::string> dependencies;
+};
+
+// =====================================================================
+// ShaderPreprocessor
+// 
+// Reads shader files in a single pass, and splits them into chunks of
+// text and #include directives, by #section. Files are kept in memory
+// until they change on disk, so a header shared by every shader is
+// only read and parsed once.
+// 
+// Includes are resolved relative to the including file, and each file
+// is only included once per section, as if it had an include guard.
+// Included files don't have sections, all of their text goes in.
+// =====================================================================
+class ShaderPreprocessor final
+{
+public:
+	// Reads the shader and expands its includes into each section
+	// @param shaderPath: path to the shader
+	// @param errorMessage: what went wrong, if anything
+	// @returns false if the shader or one of its includes cannot be read
+	bool			Process( const char* shaderPath, PreprocessedShader& result, std::string& errorMessage );
+
+	// @returns The source of one stage of a permutation: the version line, the defines for
+	// the shader flags, then the section. Built once per section hash and shader flags
+	const std::string& GetStageText( const std::string& versionText, const std::string& sectionText,
+									 const uint64_t& sectionHash, const uint16_t& shaderFlags );
+
+	// Forgets the stage texts built from this section, once no shader is made of it anymore
+	void			ReleaseStageTexts( const uint64_t& sectionHash );
+
+	// Forgets a file, so it's read again the next time even if its write time is the same
+	void			Invalidate( const std::string& path );
+
+	// @returns The #defines for the shader flags
+	static std::string DeterminePreprocessorFlags( uint16_t shaderFlags );
+
+private:
+	// Either some text, or an include
+	struct Chunk
+	{
+		std::string	section;
+		std::string	text;
+		// Normalised path of the included file, empty if this is text
+		std::string	includePath;
+	};
+
+	struct SourceFile
+	{
+		std::filesystem::file_time_type writeTime;
+		std::vector<Chunk> chunks;
+		std::string	versionText;
+		uint16_t	supportedShaderFlags{ ShaderFlag_Normal };
+	};
+
+	// @returns The file, read again if it has changed since the last time, nullptr if it cannot be read
+	const SourceFile* GetFile( const std::string& path, std::string& errorMessage );
+	static bool		ReadFile( const std::string& path, SourceFile& file, std::string& errorMessage );
+	// Appends a section of the file to text, with its includes expanded
+	// @param included: files that are already in, which are skipped
+	bool			Expand( const std::string& path, const std::string& section, std::string& text,
+							std::vector<std::string>& included, std::string& errorMessage );
+
+	// Keyed by normalised path
+	std::unordered_map<std::string, SourceFile> files;
+	// Stage texts, keyed by the section hash, then by the shader flags
+	std::unordered_map<uint64_t, std::unordered_map<uint16_t, std::string>> stageTexts;
+};
+
+extern ShaderPreprocessor gShaderPreprocessor;
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
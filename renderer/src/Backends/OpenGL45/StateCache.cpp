@@ -0,0 +1,346 @@
+#include "IRenderWorld.hpp"
+#include "StateCache.hpp"
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+StateCache gStateCache;
+
+// =====================================================================
+// StateCache::Invalidate
+// =====================================================================
+void StateCache::Invalidate()
+{
+	program = Unknown;
+	vertexArray = Unknown;
+	cullFaceMode = Unknown;
+	activeTextureUnit = Unknown;
+
+	arrayBuffer = Unknown;
+	elementArrayBuffer = Unknown;
+	uniformBuffer = Unknown;
+	shaderStorageBuffer = Unknown;
+	drawIndirectBuffer = Unknown;
+	copyReadBuffer = Unknown;
+	copyWriteBuffer = Unknown;
+
+	for ( uint32_t& texture : textures )
+	{
+		texture = Unknown;
+	}
+
+	for ( Capability& cap : capabilities )
+	{
+		cap.enabled = Unknown;
+	}
+
+	for ( uint32_t i = 0U; i < MaxIndexedBindings; i++ )
+	{
+		uniformBindings[i] = IndexedBinding();
+		storageBindings[i] = IndexedBinding();
+	}
+}
+
+// =====================================================================
+// StateCache::ResetCounters
+// =====================================================================
+void StateCache::ResetCounters()
+{
+	numSkippedCalls = 0U;
+	numStateChanges = 0U;
+}
+
+// =====================================================================
+// StateCache::UseProgram
+// =====================================================================
+bool StateCache::UseProgram( uint32_t newProgram )
+{
+	if ( program == newProgram )
+	{
+		return Skip();
+	}
+
+	glUseProgram( newProgram );
+	program = newProgram;
+	return Change();
+}
+
+// =====================================================================
+// StateCache::BindVertexArray
+// =====================================================================
+bool StateCache::BindVertexArray( uint32_t newVertexArray )
+{
+	if ( vertexArray == newVertexArray )
+	{
+		return Skip();
+	}
+
+	glBindVertexArray( newVertexArray );
+	vertexArray = newVertexArray;
+	// Each VAO has its own element buffer binding
+	elementArrayBuffer = Unknown;
+	return Change();
+}
+
+// =====================================================================
+// StateCache::BindBuffer
+// =====================================================================
+bool StateCache::BindBuffer( uint32_t target, uint32_t buffer )
+{
+	uint32_t* binding = GetBufferBinding( target );
+	if ( nullptr != binding && *binding == buffer )
+	{
+		return Skip();
+	}
+
+	glBindBuffer( target, buffer );
+	if ( nullptr != binding )
+	{
+		*binding = buffer;
+	}
+
+	return Change();
+}
+
+// =====================================================================
+// StateCache::BindBufferBase
+// =====================================================================
+bool StateCache::BindBufferBase( uint32_t target, uint32_t index, uint32_t buffer )
+{
+	return BindBufferRange( target, index, buffer, 0U, 0U );
+}
+
+// =====================================================================
+// StateCache::BindBufferRange
+// =====================================================================
+bool StateCache::BindBufferRange( uint32_t target, uint32_t index, uint32_t buffer, uint32_t offset, uint32_t size )
+{
+	IndexedBinding* indexed = GetIndexedBinding( target, index );
+	if ( nullptr != indexed && indexed->buffer == buffer && indexed->offset == offset && indexed->size == size )
+	{
+		return Skip();
+	}
+
+	if ( size == 0U )
+	{
+		glBindBufferBase( target, index, buffer );
+	}
+	else
+	{
+		glBindBufferRange( target, index, buffer, offset, size );
+	}
+
+	if ( nullptr != indexed )
+	{
+		*indexed = { buffer, offset, size };
+	}
+
+	// This binds to the generic target as well, so BindBuffer mustn't skip the next call
+	uint32_t* binding = GetBufferBinding( target );
+	if ( nullptr != binding )
+	{
+		*binding = buffer;
+	}
+
+	return Change();
+}
+
+// =====================================================================
+// StateCache::BindTexture
+// =====================================================================
+bool StateCache::BindTexture( uint8_t unit, uint32_t target, uint32_t texture )
+{
+	// Texture updates go to the active unit, so it
+	// has to be right even if the binding is skipped
+	if ( activeTextureUnit != unit )
+	{
+		glActiveTexture( GL_TEXTURE0 + unit );
+		activeTextureUnit = unit;
+	}
+
+	// Only 2D textures are tracked for now
+	if ( unit < MaxTextureUnits && target == GL_TEXTURE_2D && textures[unit] == texture )
+	{
+		return Skip();
+	}
+
+	glBindTexture( target, texture );
+	if ( unit < MaxTextureUnits && target == GL_TEXTURE_2D )
+	{
+		textures[unit] = texture;
+	}
+
+	return Change();
+}
+
+// =====================================================================
+// StateCache::SetEnabled
+// =====================================================================
+bool StateCache::SetEnabled( uint32_t capability, bool enabled )
+{
+	Capability* slot = nullptr;
+	for ( Capability& cap : capabilities )
+	{
+		if ( cap.capability == capability || cap.capability == 0U )
+		{
+			cap.capability = capability;
+			slot = &cap;
+			break;
+		}
+	}
+
+	if ( nullptr != slot && slot->enabled == uint32_t( enabled ) )
+	{
+		return Skip();
+	}
+
+	if ( enabled )
+	{
+		glEnable( capability );
+	}
+	else
+	{
+		glDisable( capability );
+	}
+
+	if ( nullptr != slot )
+	{
+		slot->enabled = enabled;
+	}
+
+	return Change();
+}
+
+// =====================================================================
+// StateCache::CullFace
+// =====================================================================
+bool StateCache::CullFace( uint32_t mode )
+{
+	if ( cullFaceMode == mode )
+	{
+		return Skip();
+	}
+
+	glCullFace( mode );
+	cullFaceMode = mode;
+	return Change();
+}
+
+// =====================================================================
+// StateCache::ForgetProgram
+// =====================================================================
+void StateCache::ForgetProgram( uint32_t deletedProgram )
+{
+	if ( program == deletedProgram )
+	{
+		program = Unknown;
+	}
+}
+
+// =====================================================================
+// StateCache::ForgetBuffer
+// =====================================================================
+void StateCache::ForgetBuffer( uint32_t deletedBuffer )
+{
+	uint32_t* bindings[] =
+	{
+		&arrayBuffer, &elementArrayBuffer, &uniformBuffer, &shaderStorageBuffer,
+		&drawIndirectBuffer, &copyReadBuffer, &copyWriteBuffer
+	};
+
+	for ( uint32_t* binding : bindings )
+	{
+		if ( *binding == deletedBuffer )
+		{
+			*binding = Unknown;
+		}
+	}
+
+	for ( uint32_t i = 0U; i < MaxIndexedBindings; i++ )
+	{
+		if ( uniformBindings[i].buffer == deletedBuffer )
+		{
+			uniformBindings[i] = IndexedBinding();
+		}
+
+		if ( storageBindings[i].buffer == deletedBuffer )
+		{
+			storageBindings[i] = IndexedBinding();
+		}
+	}
+}
+
+// =====================================================================
+// StateCache::GetBufferBinding
+// =====================================================================
+uint32_t* StateCache::GetBufferBinding( uint32_t target )
+{
+	switch ( target )
+	{
+	case GL_ARRAY_BUFFER: return &arrayBuffer;
+	case GL_ELEMENT_ARRAY_BUFFER: return &elementArrayBuffer;
+	case GL_UNIFORM_BUFFER: return &uniformBuffer;
+	case GL_SHADER_STORAGE_BUFFER: return &shaderStorageBuffer;
+	case GL_DRAW_INDIRECT_BUFFER: return &drawIndirectBuffer;
+	case GL_COPY_READ_BUFFER: return &copyReadBuffer;
+	case GL_COPY_WRITE_BUFFER: return &copyWriteBuffer;
+	}
+
+	return nullptr;
+}
+
+// =====================================================================
+// StateCache::GetIndexedBinding
+// =====================================================================
+StateCache::IndexedBinding* StateCache::GetIndexedBinding( uint32_t target, uint32_t index )
+{
+	if ( index >= MaxIndexedBindings )
+	{
+		return nullptr;
+	}
+
+	switch ( target )
+	{
+	case GL_UNIFORM_BUFFER: return &uniformBindings[index];
+	case GL_SHADER_STORAGE_BUFFER: return &storageBindings[index];
+	}
+
+	return nullptr;
+}
+
+// =====================================================================
+// StateCache::Skip
+// =====================================================================
+bool StateCache::Skip()
+{
+	numSkippedCalls++;
+	return false;
+}
+
+// =====================================================================
+// StateCache::Change
+// =====================================================================
+bool StateCache::Change()
+{
+	numStateChanges++;
+	return true;
+}
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,122 @@
+#pragma once
+
+// =====================================================================
+// StateCache
+// 
+// Shadows the OpenGL state that the backend touches: the bound program,
+// vertex array, buffers, textures per unit and enable flags. Calls that
+// wouldn't change anything never reach the driver.
+// 
+// Everything in the OpenGL 4.5 backend binds through gStateCache. If you
+// call GL directly, Invalidate the cache afterwards.
+// =====================================================================
+class StateCache final
+{
+public:
+	StateCache()
+	{
+		Invalidate();
+	}
+
+	static constexpr uint32_t MaxTextureUnits = 16U;
+	static constexpr uint32_t MaxCapabilities = 8U;
+	// Indexed uniform and shader storage buffer bindings that are shadowed
+	static constexpr uint32_t MaxIndexedBindings = 8U;
+	// Nothing is known about this piece of state, the next call goes through
+	static constexpr uint32_t Unknown = ~0U;
+
+	// Forgets all the shadowed state
+	void		Invalidate();
+	// Resets the per-frame counters
+	void		ResetCounters();
+
+	// Each of these returns true if the call actually went to the driver
+	bool		UseProgram( uint32_t program );
+	bool		BindVertexArray( uint32_t vertexArray );
+	bool		BindBuffer( uint32_t target, uint32_t buffer );
+	// Indexed binds also replace the generic binding of the target, same as in GL
+	bool		BindBufferBase( uint32_t target, uint32_t index, uint32_t buffer );
+	bool		BindBufferRange( uint32_t target, uint32_t index, uint32_t buffer, uint32_t offset, uint32_t size );
+	bool		BindTexture( uint8_t unit, uint32_t target, uint32_t texture );
+	bool		SetEnabled( uint32_t capability, bool enabled );
+	bool		CullFace( uint32_t mode );
+
+	// Deleted object names may be reused by the driver, so
+	// these must be called when a program or buffer is deleted
+	void		ForgetProgram( uint32_t program );
+	void		ForgetBuffer( uint32_t buffer );
+
+	uint32_t	GetProgram() const { return program; }
+	uint32_t	GetVertexArray() const { return vertexArray; }
+
+	// @returns How many calls were skipped since ResetCounters
+	uint32_t	GetNumSkippedCalls() const { return numSkippedCalls; }
+	// @returns How many calls went through since ResetCounters
+	uint32_t	GetNumStateChanges() const { return numStateChanges; }
+
+private:
+	// @returns The shadowed binding for this buffer target, nullptr if it isn't tracked
+	uint32_t*	GetBufferBinding( uint32_t target );
+	bool		Skip();
+	bool		Change();
+
+	struct Capability
+	{
+		uint32_t	capability{ 0U };
+		uint32_t	enabled{ Unknown };
+	};
+
+	// A size of 0 means the whole buffer is bound
+	struct IndexedBinding
+	{
+		uint32_t	buffer{ Unknown };
+		uint32_t	offset{ 0U };
+		uint32_t	size{ 0U };
+	};
+
+	// @returns The shadowed indexed binding, nullptr if it isn't tracked
+	IndexedBinding* GetIndexedBinding( uint32_t target, uint32_t index );
+
+	uint32_t	program{ Unknown };
+	uint32_t	vertexArray{ Unknown };
+	uint32_t	cullFaceMode{ Unknown };
+	uint32_t	activeTextureUnit{ Unknown };
+
+	uint32_t	arrayBuffer{ Unknown };
+	// Part of the vertex array state, so it's forgotten when the VAO changes
+	uint32_t	elementArrayBuffer{ Unknown };
+	uint32_t	uniformBuffer{ Unknown };
+	uint32_t	shaderStorageBuffer{ Unknown };
+	uint32_t	drawIndirectBuffer{ Unknown };
+	uint32_t	copyReadBuffer{ Unknown };
+	uint32_t	copyWriteBuffer{ Unknown };
+
+	uint32_t	textures[MaxTextureUnits];
+	IndexedBinding uniformBindings[MaxIndexedBindings];
+	IndexedBinding storageBindings[MaxIndexedBindings];
+	Capability	capabilities[MaxCapabilities];
+
+	uint32_t	numSkippedCalls{ 0U };
+	uint32_t	numStateChanges{ 0U };
+};
+
+extern StateCache gStateCache;
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
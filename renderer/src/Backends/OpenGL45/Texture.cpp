@@ -1,11 +1,12 @@
 #include "IRenderWorld.hpp"
 #include "FrontendTexture.hpp"
 #include "Texture.hpp"
+#include "StateCache.hpp"
 
 #define GLEW_STATIC 1
 #include <GL/glew.h>
 
-extern bool GLError( const char* why = nullptr );
+#include "DebugOutput.hpp"
 
 // =====================================================================
 // Texture::Init
@@ -23,12 +24,7 @@ void Texture::Bind( uint8_t textureUnit )
 {
 	// A texture is sometimes bound while being loaded,
 	// so it can be buffered to the GPU
-	if ( !loaded )
-	{
-		glActiveTexture( GL_TEXTURE0 + textureUnit );
-	}
-
-	glBindTexture( GL_TEXTURE_2D, textureHandle );
+	gStateCache.BindTexture( textureUnit, GL_TEXTURE_2D, textureHandle );
 
 	if ( loaded )
 		GLError( "Texture::Bind: activated the texture and bound it" );
@@ -1,288 +1,236 @@
 #include "IRenderWorld.hpp"
+#include "IRenderer.hpp"
 
 #define GLEW_STATIC 1
 #include <GL/glew.h>
 
+#include "DebugOutput.hpp"
 #include "VertexBuffer.hpp"
+#include "BufferArena.hpp"
+#include "RingBuffer.hpp"
+#include "GeometryBuffer.hpp"
 
-// =====================================================================
-// VertexArray::Init
-// =====================================================================
-void VertexArray::Init()
-{
-	glGenVertexArrays( 1, &vertexArrayHandle );
-	GLError( "VertexArray::Init: generated a VAO" );
-
-	glGenBuffers( 1, &elementBufferHandle );
-	GLError( "VertexArray::Init: generated an EBO" );
-
-	Bind();
-	GLError( "VertexArray::Init: bound the VAO" );
-
-	vertexBuffer->Bind();
-	GLError( "VertexArray::Init: bound the VBO" );
-
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, elementBufferHandle );
-	GLError( "VertexArray::Init: bound the EBO" );
-}
+#include <algorithm>
 
 // =====================================================================
-// VertexArray::Bind
+// VertexArray::ctor
 // =====================================================================
-void VertexArray::Bind( bool arrayOnly ) const
+VertexArray::VertexArray( GeometryBuffer* geometry, const ArenaRange& vertexRange, const DrawSurface* surf )
+	: geometry( geometry ), material( surf->material ), vertexRange( vertexRange )
 {
-	glBindVertexArray( vertexArrayHandle );
-	GLError( "VertexArray::Bind: bound the VAO" );
-
-	if ( !arrayOnly )
-	{
-		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, elementBufferHandle );
-		GLError( "VertexArray::Bind: bound the EBO" );
-	}
+	// Empty surfaces don't get a range and draw nothing, same as
+	// surfaces whose indices didn't fit, see Renderer_OpenGL45::AddModelGeometry
+	indexRange = geometry->AddIndices( surf->vertexIndices );
+	numIndices = (indexRange != ArenaRangeInvalid) ? surf->vertexIndices.size() : 0U;
+	GLError( "VertexArray: uploaded the surface's indices" );
 }
 
 // =====================================================================
-// VertexArray::SetupIndices
+// VertexArray::FreeIndices
 // =====================================================================
-void VertexArray::BufferData( int type )
+void VertexArray::FreeIndices()
 {
-	Bind( false );
-	GLError( "VertexArray::BufferData: bound the VAO and EBO" );
-
-	vertexBuffer->Bind();
-	GLError( "VertexArray::BufferData: bound the VBO" );
-
-	glBufferData( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( vertexid_t ), indices.data(), type );
-	GLError( "VertexArray::BufferData: buffered GL_ELEMENT_ARRAY_BUFFER with indices.data()" );
+	geometry->FreeIndices( indexRange );
+	indexRange = ArenaRangeInvalid;
+	numIndices = 0U;
 }
 
 // =====================================================================
-// VertexArray::SetupIndices
+// VertexArray::Bind
 // =====================================================================
-void VertexArray::SetupIndices( const DrawSurface* surf )
+void VertexArray::Bind( const InstanceLayout& layout ) const
 {
-	indices = surf->vertexIndices;
+	geometry->Bind( layout );
 }
 
 // =====================================================================
-// VertexArray::SetupVertexAttributes
+// VertexArray::GetHandle
 // =====================================================================
-void VertexArray::SetupVertexAttributes() const
+GLuint VertexArray::GetHandle() const
 {
-	using attribs = VertexAttributes;
-	using offsets = VertexAttribOffsets;
-
-	SetupSingleVertexAttrib( attribs::Positions, 3, offsets::Positions );
-	GLError( "VertexArray::SetupVertexAttributes: set up Positions" );
-	SetupSingleVertexAttrib( attribs::Normals,   3, offsets::Normals );
-	GLError( "VertexArray::SetupVertexAttributes: set up Normals" );
-	SetupSingleVertexAttrib( attribs::TexCoords, 2, offsets::TexCoords );
-	GLError( "VertexArray::SetupVertexAttributes: set up TexCoords" );
+	return geometry->GetVertexArray( InstanceLayout_None );
 }
 
 // =====================================================================
-// VertexArray::SetupSingleVertexAttrib
+// VertexArray::GetFirstIndex
 // =====================================================================
-void VertexArray::SetupSingleVertexAttrib( const int& attribType, const int& size, const int& offset, const int& stride )
+uint32_t VertexArray::GetFirstIndex() const
 {
-	glEnableVertexAttribArray( attribType );
-	GLError( "VertexArray::SetupSingleVertexAttrib: called glEnableVertexAttribArray" );
-	glVertexAttribPointer( attribType, size, GL_FLOAT, GL_FALSE, stride, VBOffset( offset ) );
-	GLError( "VertexArray::SetupSingleVertexAttrib: called glVertexAttribPointer" );
+	return geometry->GetIndices().GetOffset( indexRange );
 }
 
 // =====================================================================
-// VertexArray::PrintDebugInfo
+// VertexArray::GetBaseVertex
 // =====================================================================
-void VertexArray::PrintDebugInfo() const
+int32_t VertexArray::GetBaseVertex() const
 {
-	return;
-
-	int info;
-	glGetVertexArrayiv( vertexArrayHandle, GL_ELEMENT_ARRAY_BUFFER_BINDING, &info );
-
-	printf( "VertexArray::PrintDebugInfo: VA's VBO handle is %i\n", info );
+	return geometry->GetVertices().GetOffset( vertexRange );
 }
 
 // =====================================================================
 // InstancedArray::ctor
 // =====================================================================
-InstancedArray::InstancedArray( RenderBatchParam* params, const uint32_t& size )
-	: batchParams( params ), batchSize( size )
+InstancedArray::InstancedArray( BufferArena* arena, RingBuffer* staging, const InstanceLayout& layout, const void* params, const uint32_t& size )
+	: batchSize( size ), layout( layout ), stride( GetInstanceStride( layout ) ), arena( arena ), staging( staging )
 {
-	Init();
-	BufferData();
-}
+	const uint8_t* bytes = static_cast<const uint8_t*>( params );
+	batchParams.assign( bytes, bytes + size * stride );
 
-// =====================================================================
-// InstancedArray::Init
-// =====================================================================
-void InstancedArray::Init()
-{
-	glGenBuffers( 1, &instancedBufferHandle );
+	range = arena->Allocate( size );
+	if ( range == ArenaRangeInvalid )
+	{
+		Release();
+		return;
+	}
+
+	BufferData();
 }
 
 // =====================================================================
 // InstancedArray::Update
 // =====================================================================
-void InstancedArray::Update( RenderBatchParam* params, const uint32_t& size )
+bool InstancedArray::Update( const void* params, const uint32_t& first, const uint32_t& count )
 {
-	if ( nullptr == params || !size )
+	if ( !IsValid() || nullptr == params || !count )
 	{
-		return;
+		return false;
 	}
 
-	batchParams = params;
-	batchSize = size;
+	const uint8_t* bytes = static_cast<const uint8_t*>( params );
+	const uint32_t end = first + count;
 
-	// Bigger new batch size -> call glBufferData
-	// Smaller new batch size or equal -> only call glBufferSubData cuz' cheaper
-	BufferData( size > batchSize );
+	// Doesn't fit anymore, move to a bigger range and upload everything there
+	// The old range is only given back once there is a new one, so the batch
+	// stays as it was if there's no room
+	if ( end > arena->GetSize( range ) )
+	{
+		const ArenaRange newRange = arena->Allocate( end );
+		if ( newRange == ArenaRangeInvalid )
+		{
+			return false;
+		}
+
+		arena->Free( range );
+		range = newRange;
+
+		batchParams.resize( end * stride );
+		batchSize = end;
+		std::copy( bytes, bytes + count * stride, batchParams.begin() + first * stride );
+		dirtySpans.clear();
+		MarkDirty( 0U, batchSize );
+		return true;
+	}
+
+	if ( end > batchSize )
+	{
+		batchParams.resize( end * stride );
+		batchSize = end;
+	}
+
+	std::copy( bytes, bytes + count * stride, batchParams.begin() + first * stride );
+	MarkDirty( first, count );
+	return true;
 }
 
 // =====================================================================
-// InstancedArray::Bind
+// InstancedArray::Release
 // =====================================================================
-void InstancedArray::Bind()
+void InstancedArray::Release()
 {
-	glBindBuffer( GL_ARRAY_BUFFER, instancedBufferHandle );
+	if ( range != ArenaRangeInvalid )
+	{
+		arena->Free( range );
+		range = ArenaRangeInvalid;
+	}
+
+	batchParams.clear();
+	batchParams.shrink_to_fit();
+	batchSize = 0U;
+	dirtySpans.clear();
 }
 
 // =====================================================================
-// InstancedArray::Unbind
+// InstancedArray::BufferData
 // =====================================================================
-void InstancedArray::Unbind()
+void InstancedArray::BufferData()
 {
-	using attribs = VertexAttributes;
-
-	glDisableVertexAttribArray( attribs::BatchModelMatrix + 0 );
-	glDisableVertexAttribArray( attribs::BatchModelMatrix + 1 );
-	glDisableVertexAttribArray( attribs::BatchModelMatrix + 2 );
-	glDisableVertexAttribArray( attribs::BatchModelMatrix + 3 );
+	if ( batchParams.empty() )
+	{
+		return;
+	}
 
-	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	// Fill the range with transform data
+	arena->UploadStaged( *staging, range, batchParams.data(), 0U, batchSize );
 }
 
 // =====================================================================
-// InstancedArray::BufferData
+// InstancedArray::MarkDirty
 // =====================================================================
-void InstancedArray::BufferData( bool resize )
+void InstancedArray::MarkDirty( const uint32_t& first, const uint32_t& count )
 {
-	if ( nullptr == batchParams )
+	if ( first >= batchSize || !count )
 	{
 		return;
 	}
 
-	Bind();
+	DirtySpan span{ first, std::min( count, batchSize - first ) };
+
+	// Find where it goes, then swallow every span it touches on either side
+	auto it = std::lower_bound( dirtySpans.begin(), dirtySpans.end(), span,
+		[]( const DirtySpan& a, const DirtySpan& b ) { return a.first < b.first; } );
 
-	// Fill the IBO with transform data
-	if ( resize )
-	{	// GL_DYNAMIC_DRAW cuz' this can change often
-		glBufferData( GL_ARRAY_BUFFER, sizeof( RenderBatchParam ) * batchSize, batchParams, GL_DYNAMIC_DRAW );
-		printf( "InstancedArray::BufferData: batchSize = %i\n", (int)batchSize );
+	if ( it != dirtySpans.begin() )
+	{
+		auto previous = it - 1;
+		if ( previous->first + previous->count + SpanMergeGap >= span.first )
+		{
+			it = previous;
+		}
 	}
-	else
+
+	auto last = it;
+	while ( last != dirtySpans.end() && last->first <= span.first + span.count + SpanMergeGap )
 	{
-		glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof( RenderBatchParam ) * batchSize, batchParams );
-		printf( "InstancedArray::BufferSubData: batchSize = %i\n", (int)batchSize );
+		const uint32_t start = std::min( span.first, last->first );
+		const uint32_t end = std::max( span.first + span.count, last->first + last->count );
+		span = { start, end - start };
+		last++;
 	}
 
+	it = dirtySpans.erase( it, last );
+	dirtySpans.insert( it, span );
 }
 
 // =====================================================================
-// InstancedArray::SetupVertexAttributes
-// 
-// Lots of things can go wrong here lol
-// Assumes this IBO is already bound with a bound VAO
+// InstancedArray::Flush
 // =====================================================================
-void InstancedArray::SetupVertexAttributes()
+uint32_t InstancedArray::Flush()
 {
-	// sizeof(vec3) + sizeof(mat4)
-	constexpr int InstancedArrayStride = 16 * sizeof( float );
-	using attribs = VertexAttributes;
-	using offsets = VertexAttribOffsets;
-
-	// Model matrices
-	VertexArray::SetupSingleVertexAttrib( attribs::BatchModelMatrix + 0, 4, offsets::BatchModelMatrix + offsets::Vec4Size * 0, InstancedArrayStride );
-	VertexArray::SetupSingleVertexAttrib( attribs::BatchModelMatrix + 1, 4, offsets::BatchModelMatrix + offsets::Vec4Size * 1, InstancedArrayStride );
-	VertexArray::SetupSingleVertexAttrib( attribs::BatchModelMatrix + 2, 4, offsets::BatchModelMatrix + offsets::Vec4Size * 2, InstancedArrayStride );
-	VertexArray::SetupSingleVertexAttrib( attribs::BatchModelMatrix + 3, 4, offsets::BatchModelMatrix + offsets::Vec4Size * 3, InstancedArrayStride );
-	GLError( "InstancedArray::SetupVertexAttributes: set up BatchModelMatrix" );
-	
-	// Reset the current array buffer
-	glBindBuffer( GL_ARRAY_BUFFER, 0 );
-	
-	// Update batch data every 1 instance
-	glVertexAttribDivisor( attribs::BatchModelMatrix + 0, 1 );
-	glVertexAttribDivisor( attribs::BatchModelMatrix + 1, 1 );
-	glVertexAttribDivisor( attribs::BatchModelMatrix + 2, 1 );
-	glVertexAttribDivisor( attribs::BatchModelMatrix + 3, 1 );
-	GLError( "InstancedArray::SetupVertexAttributes: called glVertexAttribDivisor on BatchModelMatrix" );
+	uint32_t uploadedBytes = 0U;
+	for ( const DirtySpan& span : dirtySpans )
+	{
+		arena->UploadStaged( *staging, range, batchParams.data() + span.first * stride, span.first, span.count );
+		uploadedBytes += span.count * stride;
+	}
+
+	dirtySpans.clear();
+	return uploadedBytes;
 }
 
 // =====================================================================
-// VertexBuffer::Init
+// InstancedArray::GetHandle
 // =====================================================================
-void VertexBuffer::Init()
+GLuint InstancedArray::GetHandle() const
 {
-	// Generate a vertex buffer and the array buffer
-	glGenBuffers( 1, &vertexBufferHandle );
+	return arena->GetBuffer();
 }
 
 // =====================================================================
-// VertexBuffer::Init
+// InstancedArray::GetBaseInstance
 // =====================================================================
-void VertexBuffer::Init( const DrawMesh* mesh )
-{
-	data.clear();
-
-	// Fill our local vertex buffer
-	for ( const DrawVertex& vert : mesh->vertices )
-	{
-		data.push_back( vert.position.x );
-		data.push_back( vert.position.y );
-		data.push_back( vert.position.z );
-
-		data.push_back( (float)vert.normal.x / 127.0f );
-		data.push_back( (float)vert.normal.y / 127.0f );
-		data.push_back( (float)vert.normal.z / 127.0f );
-		
-		data.push_back( (float)vert.texCoords.x / 32767.0f );
-		data.push_back( (float)vert.texCoords.y / 32767.0f );
-	}
-
-	// Init, bind and buffer the stuff
-	Init();
-	BufferData( data.data(), data.size() * sizeof(float), VB_Static );
-}
-
-// ===============================================================================================
-// VertexBuffer::Bind
-// ===============================================================================================
-void VertexBuffer::Bind() const
+uint32_t InstancedArray::GetBaseInstance() const
 {
-	// Bind the vertex buffer
-	glBindBuffer( GL_ARRAY_BUFFER, vertexBufferHandle );
-}
-
-// ===============================================================================================
-// VertexBuffer::BufferData
-// ===============================================================================================
-void VertexBuffer::BufferData( const float* vertexData, size_t size, int type )
-{
-	if ( nullptr == vertexData )
-	{
-		vertexData = data.data();
-		size = data.size() * sizeof(float);
-	}
-
-	Bind();
-	// Fill the VBO with vertex data
-	glBufferData( GL_ARRAY_BUFFER, size, vertexData, type );
-	// Determine the number of vertices
-	numVertices = size / VertexArray::Stride;
-
-	printf( "VertexBuffer::BufferData: numVertices = %i\n", (int)numVertices );
+	return arena->GetOffset( range );
 }
 
 /*
@@ -9,6 +9,9 @@ struct VertexAttributes
     // BatchOrientation will take up 7, 8, 9 and 10
     // because mat4 is equivalent to four vec4s
     static constexpr int BatchModelMatrix = 7;
+    // Compact instances take up 7 and 8 instead
+    static constexpr int BatchPositionScale = 7;
+    static constexpr int BatchOrientation = 8;
 };
 
 struct VertexAttribOffsets
@@ -25,73 +28,72 @@ struct VertexAttribOffsets
     static constexpr int TexCoords = Normals + 3*FloatSize;
 
     static constexpr int BatchModelMatrix = 0;
+    static constexpr int BatchPositionScale = 0;
+    static constexpr int BatchOrientation = BatchPositionScale + Vec4Size;
 };
 
-class DrawMesh;
-class VertexBuffer;
-
-enum
+// Which per-instance attributes a vertex array has
+enum InstanceLayout : uint8_t
 {
-    VB_Static = 0x88E4,
-    VB_Dynamic = 0x88E8,
-    VB_Stream = 0x88E0
+    // Not instanced
+    InstanceLayout_None = 0,
+    // A model matrix per instance, i.e. RenderBatchParam
+    InstanceLayout_Matrix,
+    // Position, scale and a quaternion per instance, i.e. RenderBatchCompactParam
+    InstanceLayout_Compact,
+
+    InstanceLayout_MAX
 };
 
-extern bool GLError( const char* why );
+// @returns Size of one instance in this layout
+constexpr uint32_t GetInstanceStride( const InstanceLayout& layout )
+{
+    return layout == InstanceLayout_Compact ? sizeof( RenderBatchCompactParam ) : sizeof( RenderBatchParam );
+}
+
+class GeometryBuffer;
+class BufferArena;
+class RingBuffer;
+using ArenaRange = uint32_t;
 
 // =====================================================================
 // VertexArray
 // 
-// Manages VAOs and EBOs
 // Is used to draw stuff
 // 
-// Every draw surface is equivalent to one vertex array
-// When initialising a model, you first generate & bind a VAO&EBO,
-// then generate, bind & buffer a VBO, then set up vertex attributes
+// Every draw surface is equivalent to one vertex array. It doesn't own
+// any GL objects, it's just a range of vertices and a range of indices
+// within a GeometryBuffer, drawn with its VAO. The ranges can be moved
+// around by defragmentation, so the offsets are looked up every time
 // =====================================================================
 class VertexArray
 {
 public:
-    VertexArray( VertexBuffer* buffer )
-        : vertexBuffer( buffer )
-    {
-        indices.clear();
-        Init();
-    }
+    VertexArray( GeometryBuffer* geometry, const ArenaRange& vertexRange, const DrawSurface* surf );
 
-    VertexArray( VertexBuffer* buffer, const DrawSurface* surf )
-        : vertexBuffer( buffer ), material( surf->material )
+    // Gives the indices back to the geometry buffer, the vertices belong to the whole model
+    void FreeIndices();
+
+    // Binds the geometry buffer's VAO for this instance layout
+    void Bind( const InstanceLayout& layout = InstanceLayout_None ) const;
+
+    uint32_t GetFirstIndex() const;
+    int32_t GetBaseVertex() const;
+
+    inline size_t GetNumIndices() const
     {
-        indices.clear();
-        SetupIndices( surf );
-        // Generate element indices
-        Init();
-        GLError( "initialised the vertex array" );
-        PrintDebugInfo();
-        // Buffer the indices
-        BufferData( VB_Static );
-        GLError( "buffered data for the vertex array's element buffer" );
-        PrintDebugInfo();
-        // Set up the vertex attributes
-        SetupVertexAttributes();
-        GLError( "set up the vertex array's attributes" );
-        PrintDebugInfo();
+        return numIndices;
     }
 
-    void Init();
-    void Bind( bool arrayOnly = true ) const;
-    void BufferData( int type );
-    // Sets up vertex attributes
-    void SetupVertexAttributes() const;
-
-    inline const void* GetIndexData() const
+    // @returns Offset into the element buffer for glDrawElements*
+    inline void* GetIndexOffset() const
     {
-        return indices.data();
+        return VBOffset( GetFirstIndex() * sizeof( vertexid_t ) );
     }
 
-    inline size_t GetNumIndices() const
+    inline ArenaRange GetVertexRange() const
     {
-        return indices.size();
+        return vertexRange;
     }
 
     inline IMaterial* GetMaterial() const
@@ -99,91 +101,91 @@ public:
         return material;
     }
 
-    static constexpr size_t Stride = 8U * sizeof( float );
-    
-    void PrintDebugInfo() const;
+    inline GeometryBuffer* GetGeometry() const
+    {
+        return geometry;
+    }
+
+    // @returns The VAO, shared by all surfaces in the same geometry buffer
+    GLuint GetHandle() const;
 
-    static void* VBOffset( const int& num )
+    static void* VBOffset( const size_t& num )
     {
         return reinterpret_cast<void*>(num);
     }
 
-    static void SetupSingleVertexAttrib( const int& attribType, const int& size = 3, const int& offset = 0, const int& stride = Stride );
-
 private:
-    void SetupIndices( const DrawSurface* surf );
-
-    GLuint vertexArrayHandle{ 0 };
-    GLuint elementBufferHandle{ 0 };
-    std::vector<vertexid_t> indices;
-    VertexBuffer* vertexBuffer{ nullptr };
+    GeometryBuffer* geometry{ nullptr };
     IMaterial* material{ nullptr };
+    ArenaRange vertexRange{ ~0U };
+    ArenaRange indexRange{ ~0U };
+    uint32_t numIndices{ 0 };
 };
 
 // =====================================================================
 // InstancedArray
 // 
 // Represents an OpenGL instanced array to be used with batch rendering
+// 
+// Batches live in a range of the instance arena and are drawn with
+// a base instance. Their data goes through the staging ring on its way
+// there, so updating a batch that's still being drawn doesn't stall
 // =====================================================================
 class InstancedArray
 {
 public:
-    InstancedArray( RenderBatchParam* params, const uint32_t& size );
-
-    void Init();
-    void Update( RenderBatchParam* params, const uint32_t& size );
-    void Bind();
-    void Unbind();
-    void BufferData( bool resize = true );
-    void SetupVertexAttributes();
-    bool IsValid() const { return (nullptr != batchParams) && (batchSize > BatchSizeThreshold); }
+    // Copies the params, the caller's memory isn't referenced afterwards
+    // @param arena: has to have elements of GetInstanceStride( layout ) bytes
+    // @param params: array of size instances in the given layout
+    InstancedArray( BufferArena* arena, RingBuffer* staging, const InstanceLayout& layout, const void* params, const uint32_t& size );
+
+    // Copies params into instances [first, first + count) and marks them dirty,
+    // the array grows if that goes past its end
+    // @returns false if it couldn't grow, the array is left as it was then
+    bool Update( const void* params, const uint32_t& first, const uint32_t& count );
+    // Frees the instance range and the local copy, leaving the array invalid
+    void Release();
+    // Uploads the whole batch into its range of the arena
+    void BufferData();
+    bool IsValid() const { return !batchParams.empty() && (batchSize > BatchSizeThreshold); }
+
+    // Marks instances [first, first + count) to be uploaded in the next Flush
+    // Overlapping and nearby spans are merged into one
+    void MarkDirty( const uint32_t& first, const uint32_t& count );
+    // Uploads all the dirty spans
+    // @returns How many bytes were uploaded
+    uint32_t Flush();
+    bool IsDirty() const { return !dirtySpans.empty(); }
+    uint32_t GetBatchSize() const { return batchSize; }
+    InstanceLayout GetLayout() const { return layout; }
+
+    // The geometry buffer reads the per-instance attributes straight from this
+    GLuint GetHandle() const;
+    // @returns Where this array's instances start in GetHandle's buffer
+    uint32_t GetBaseInstance() const;
 
 private:
-    RenderBatchParam* batchParams{ nullptr };
+    // Owned copy of the batch data, dirty spans are uploaded from here
+    std::vector<uint8_t> batchParams;
     uint32_t batchSize{ 0 };
+    InstanceLayout layout{ InstanceLayout_Matrix };
+    uint32_t stride{ sizeof( RenderBatchParam ) };
 
-    GLuint instancedBufferHandle{ 0 };
-};
+    BufferArena* arena{ nullptr };
+    RingBuffer* staging{ nullptr };
+    ArenaRange range{ ~0U };
 
-// =====================================================================
-// VertexBuffer
-// 
-// Manages VBOs
-// Holds render data
-// =====================================================================
-class VertexBuffer
-{
-public:
-    VertexBuffer()
+    struct DirtySpan
     {
-        Init();
-    }
-
-    VertexBuffer( const DrawMesh* mesh )
-    {
-        Init( mesh );
-    }
-
-    // Generates buffers
-    void Init();
-    // Generates a vertex buffer + array buffers from the mesh
-    // @param mesh: the mesh to generate this buffer from
-    void Init( const DrawMesh* mesh );
-    // Binds the whole thing
-    void Bind() const;
-    // Loads data
-    void BufferData( const float* data, size_t size, int type = VB_Static );
-    
-    inline const size_t& GetNumVertices() const
-    {
-        return numVertices;
-    }
-
-private:
-    GLuint vertexBufferHandle{ 0 };
-    size_t numVertices{ 0 };
-
-    std::vector<float> data;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // Sorted by first, never overlapping
+    std::vector<DirtySpan> dirtySpans;
+    // Spans closer than this many instances are uploaded as one,
+    // a few clean instances are cheaper than another copy command
+    static constexpr uint32_t SpanMergeGap = 16U;
 };
 
 /*
@@ -0,0 +1,225 @@
+#include "FileWatcher.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#if defined( __linux__ )
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// =====================================================================
+// FileWatcher::Start
+// =====================================================================
+void FileWatcher::Start()
+{
+    if ( IsRunning() )
+    {
+        return;
+    }
+
+#if defined( __linux__ )
+    inotifyHandle = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if ( inotifyHandle < 0 )
+    {
+        printf( "FileWatcher: inotify is not available, polling every %i ms instead\n", PollInterval );
+    }
+#endif
+
+    quit = false;
+    thread = std::thread( &FileWatcher::WatcherLoop, this );
+}
+
+// =====================================================================
+// FileWatcher::Stop
+// =====================================================================
+void FileWatcher::Stop()
+{
+    if ( !IsRunning() )
+    {
+        return;
+    }
+
+    // The thread never sleeps for longer than PollInterval
+    quit = true;
+    thread.join();
+
+    std::lock_guard<std::mutex> lock( mutex );
+    files.clear();
+    changes.clear();
+
+#if defined( __linux__ )
+    if ( inotifyHandle >= 0 )
+    {
+        close( inotifyHandle );
+        inotifyHandle = -1;
+    }
+    directories.clear();
+#endif
+}
+
+// =====================================================================
+// FileWatcher::Watch
+// =====================================================================
+void FileWatcher::Watch( const std::string& path )
+{
+    const std::string normalisedPath = NormalisePath( path );
+
+    std::lock_guard<std::mutex> lock( mutex );
+    if ( files.count( normalisedPath ) )
+    {
+        return;
+    }
+
+    std::error_code error;
+    files[normalisedPath] = fs::last_write_time( normalisedPath, error );
+
+#if defined( __linux__ )
+    if ( inotifyHandle < 0 )
+    {
+        return;
+    }
+
+    // Watching the file itself would lose track of it as soon as an editor replaces it
+    const std::string directory = fs::path( normalisedPath ).parent_path().generic_string();
+    for ( const auto& pair : directories )
+    {
+        if ( pair.second == directory )
+        {
+            return;
+        }
+    }
+
+    const int watch = inotify_add_watch( inotifyHandle, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO );
+    if ( watch >= 0 )
+    {
+        directories[watch] = directory;
+    }
+#endif
+}
+
+// =====================================================================
+// FileWatcher::TakeChanges
+// =====================================================================
+void FileWatcher::TakeChanges( std::vector<std::string>& changedFiles )
+{
+    std::lock_guard<std::mutex> lock( mutex );
+    changedFiles.insert( changedFiles.end(), changes.begin(), changes.end() );
+    changes.clear();
+}
+
+// =====================================================================
+// FileWatcher::NormalisePath
+// =====================================================================
+std::string FileWatcher::NormalisePath( const std::string& path )
+{
+    std::error_code error;
+    const fs::path absolutePath = fs::absolute( path, error );
+    return (error ? fs::path( path ) : absolutePath).lexically_normal().generic_string();
+}
+
+// =====================================================================
+// FileWatcher::AddChange
+// =====================================================================
+void FileWatcher::AddChange( const std::string& path )
+{
+    if ( std::find( changes.begin(), changes.end(), path ) == changes.end() )
+    {
+        changes.push_back( path );
+    }
+}
+
+// =====================================================================
+// FileWatcher::WatcherLoop
+// =====================================================================
+void FileWatcher::WatcherLoop()
+{
+    while ( !quit )
+    {
+#if defined( __linux__ )
+        if ( inotifyHandle >= 0 )
+        {
+            pollfd pollHandle{ inotifyHandle, POLLIN, 0 };
+            if ( poll( &pollHandle, 1, PollInterval ) <= 0 )
+            {
+                continue;
+            }
+
+            alignas( inotify_event ) char buffer[4096];
+            ssize_t length = 0;
+            while ( (length = read( inotifyHandle, buffer, sizeof( buffer ) )) > 0 )
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                for ( ssize_t offset = 0; offset < length; )
+                {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>( buffer + offset );
+                    offset += sizeof( inotify_event ) + event->len;
+
+                    auto directory = directories.find( event->wd );
+                    if ( event->len == 0 || directory == directories.end() )
+                    {
+                        continue;
+                    }
+
+                    // Everything else in the directory is none of our business
+                    const std::string path = directory->second + "/" + event->name;
+                    if ( files.count( path ) )
+                    {
+                        AddChange( path );
+                    }
+                }
+            }
+
+            continue;
+        }
+#endif
+
+        std::this_thread::sleep_for( std::chrono::milliseconds( PollInterval ) );
+
+        // Checking thousands of files takes a while, so the renderer
+        // shouldn't have to wait for it in TakeChanges
+        std::vector<std::pair<std::string, fs::file_time_type>> checkedFiles;
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            checkedFiles.assign( files.begin(), files.end() );
+        }
+
+        for ( auto& pair : checkedFiles )
+        {
+            // Files that are being replaced may briefly not exist, they'll show up next time
+            std::error_code error;
+            const fs::file_time_type writeTime = fs::last_write_time( pair.first, error );
+            if ( error || writeTime == pair.second )
+            {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock( mutex );
+            files[pair.first] = writeTime;
+            AddChange( pair.first );
+        }
+    }
+}
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// =====================================================================
+// FileWatcher
+// 
+// Watches files for changes on a thread of its own. On Linux, it asks
+// inotify about the directories the files are in, which also catches
+// editors that save by renaming a temporary file over the original.
+// Elsewhere, it compares the files' write times every PollInterval.
+// Changes pile up until TakeChanges picks them up, so the renderer can
+// deal with them at a frame boundary.
+// =====================================================================
+class FileWatcher final
+{
+public:
+    // Starts the watcher thread
+    void                Start();
+    // Stops the watcher thread and forgets all files
+    void                Stop();
+    bool                IsRunning() const { return thread.joinable(); }
+
+    // Starts watching a file, if it isn't already. Can be called from any thread
+    void                Watch( const std::string& path );
+    // Moves the normalised paths of the files that changed since the last call into changedFiles
+    void                TakeChanges( std::vector<std::string>& changedFiles );
+
+    // @returns The path as the watcher reports it, absolute and normalised
+    static std::string  NormalisePath( const std::string& path );
+
+    // How often write times are compared without inotify, in milliseconds
+    static constexpr int PollInterval = 50;
+
+private:
+    void                WatcherLoop();
+    // Adds the file to the changes, unless it's already in there
+    // Needs the mutex to be locked
+    void                AddChange( const std::string& path );
+
+    std::thread         thread;
+    std::atomic<bool>   quit{ false };
+
+    std::mutex          mutex;
+    // Watched files and their last known write times
+    std::unordered_map<std::string, std::filesystem::file_time_type> files;
+    std::vector<std::string> changes;
+
+#if defined( __linux__ )
+    int                 inotifyHandle{ -1 };
+    // inotify watch descriptors and the directories they belong to
+    std::unordered_map<int, std::string> directories;
+#endif
+};
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -2,6 +2,104 @@
 
 #include "Backends/BackendRegistry.hpp"
 
+// Same layout as the indirect command of glMultiDrawElementsIndirect
+// (and VkDrawIndexedIndirectCommand, for that matter)
+struct DrawElementsIndirectCommand
+{
+    uint32_t    count;          // number of indices
+    uint32_t    instanceCount;
+    uint32_t    firstIndex;
+    int32_t     baseVertex;
+    uint32_t    baseInstance;   // index of this command's first DrawData
+};
+
+// Per-draw data for indirect drawing, std430 layout
+// Every instance of every indirect command gets one
+struct DrawData
+{
+    glm::mat4   modelMatrix;
+    uint32_t    materialIndex;
+    uint32_t    padding[3];
+};
+
+// Indirect commands with the same shader, material and vertex array,
+// drawn with a single multi-draw call
+struct DrawIndirectBucket
+{
+    // Any model surface in the bucket, for the material and vertex array
+    RenderModelHandle   model;
+    int                 surface;
+    uint32_t            firstCommand;
+    uint32_t            numCommands;
+
+    // Used by the frontend to tell when a new bucket starts
+    // The material is compared as well, its index in the key can wrap around
+    uint64_t            stateKey;
+    const IMaterial*    material;
+    uint32_t            vertexArray;
+};
+
+// Everything the backend needs for indirect drawing in one frame
+struct DrawIndirectList
+{
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<DrawData>           drawData;
+    std::vector<DrawIndirectBucket> buckets;
+
+    void Clear()
+    {
+        commands.clear();
+        drawData.clear();
+        buckets.clear();
+    }
+};
+
+// Where a model surface's geometry lives in the backend
+struct SurfaceGeometry
+{
+    uint32_t    firstIndex;
+    uint32_t    numIndices;
+    int32_t     baseVertex;
+    // Backend-specific ID, surfaces with the same one can be drawn together
+    uint32_t    vertexArray;
+};
+
+// Sub-allocated GPU buffers of the backend
+enum GpuArena : uint8_t
+{
+    GpuArena_Vertices = 0,
+    GpuArena_Indices,
+    GpuArena_Instances,
+    GpuArena_CompactInstances,
+
+    GpuArena_MAX
+};
+
+// What a render batch is made of
+enum BatchFormat : uint8_t
+{
+    // RenderBatchParam
+    BatchFormat_Matrix = 0,
+    // RenderBatchCompactParam
+    BatchFormat_Compact,
+
+    BatchFormat_MAX
+};
+
+// Memory usage of a GpuArena, all sizes in bytes
+struct GpuArenaStats
+{
+    uint32_t    capacity{ 0U };
+    uint32_t    used{ 0U };
+    uint32_t    largestFreeRegion{ 0U };
+    uint32_t    numFreeRegions{ 0U };
+    uint32_t    numAllocations{ 0U };
+    // 0 when all free space is in one piece, close to 1 when it's scattered all over
+    float       fragmentation{ 0.0f };
+    // Moved around by defragmentation this frame
+    uint32_t    bytesMoved{ 0U };
+};
+
 class IRenderer
 {
 public:
@@ -27,12 +125,33 @@ public:
     virtual void                ReloadShaders() = 0;
 
     // Renders multiple DrawSurface instances, is still equivalent to 1 drawcall (depending on the backend)
-    // @param params: render entity parameters, to position and rotate the model in space, among other things
+    // @param model: handle of the model to render
+    // @param modelMatrix: the render entity's world matrix, cached in the frontend
     // @param surface: surface ID, must not be bigger than the number of surfaces in a model
     // @param batchHandle: handle to the backend batch object; draws single instance if invalid
     // @param batchSize: how many instances to draw; draws single instances if 0 or 1
-    virtual void                RenderSurfaceBatch( const RenderEntityParams& params, const int& surface,
+    virtual void                RenderSurfaceBatch( const RenderModelHandle& model, const glm::mat4& modelMatrix, const int& surface,
                                                     const BatchHandle& batchHandle, const int& batchSize ) = 0;
+    // Reserves GPU-visible memory for instances that are only drawn this frame.
+    // Write the model matrices straight into it, there's no copy afterwards
+    // @param outFirstInstance: pass this on to RenderSurfaceInstances
+    // @returns nullptr if there's no room left this frame
+    virtual RenderBatchParam*   AllocateTransientInstances( const uint32_t& numInstances, uint32_t& outFirstInstance ) = 0;
+    // Renders a surface once for every instance, in 1 drawcall
+    // The instance data is only used for this draw, so it doesn't need a batch
+    // @param model: handle of the model to render
+    // @param surface: surface ID, must not be bigger than the number of surfaces in a model
+    // @param firstInstance: from AllocateTransientInstances
+    // @param numInstances: how many instances to draw
+    virtual void                RenderSurfaceInstances( const RenderModelHandle& model, const int& surface,
+                                                        const uint32_t& firstInstance, const int& numInstances ) = 0;
+
+    // @returns Whether RenderIndirect can be used at all
+    virtual bool                SupportsIndirectDrawing() const = 0;
+    // @returns Where the surface's indices and vertices are, for indirect commands
+    virtual SurfaceGeometry     GetSurfaceGeometry( const RenderModelHandle& model, const int& surface ) = 0;
+    // Uploads the commands and per-draw data, then renders each bucket with one multi-draw call
+    virtual void                RenderIndirect( const DrawIndirectList& list ) = 0;
 
     // Set the render view, update the viewport etc.
     virtual void                SetRenderView( const RenderView* view ) = 0;
@@ -45,21 +164,42 @@ public:
     virtual void                CopyFrameToTexture( ITexture* texture ) = 0;
 
     // Creates a model from given parameters
+    // @returns RenderHandleInvalid if its geometry doesn't fit
     virtual RenderModelHandle   CreateModel( const RenderModelParams& params, const DrawMesh* model ) = 0;
     // Updates a model, only for dynamic models
-    virtual void                UpdateModel( const RenderModelHandle& handle, const DrawMesh* model ) = 0;
+    // @returns false if the new geometry doesn't fit, the model keeps the old one then
+    virtual bool                UpdateModel( const RenderModelHandle& handle, const DrawMesh* model ) = 0;
 
     // Creates a texture from given data
     virtual ITexture*           AllocateTexture( const char* name ) = 0;
     // Updates a texture with new data
     virtual void                UpdateTexture( ITexture* texture, byte* data ) = 0;
 
-    // Registers a render batch so a render entity can be rendered in multiple instances
-    virtual BatchHandle         CreateBatch( RenderBatchParam* params, const int& batchSize ) = 0;
-    // Updates data for this render batch
-    virtual void                UpdateBatch( const BatchHandle& handle, RenderBatchParam* params, const int& batchSize ) = 0;
+    // Copies the params into a new render batch, so render entities can be rendered in multiple instances
+    // @param params: array of RenderBatchParam or RenderBatchCompactParam, depending on the format
+    virtual BatchHandle         CreateBatch( const void* params, const uint32_t& batchSize, const BatchFormat& format ) = 0;
+    // Copies params into instances [first, first + count) of the batch, they are uploaded in the next BeginFrame
+    // The params have to be in the batch's format
+    // @returns false if the batch had to grow and there's no room for it, it's left as it was then
+    virtual bool                UpdateBatch( const BatchHandle& handle, const void* params, const uint32_t& first, const uint32_t& count ) = 0;
+    // Frees the batch and its handle for reuse
+    virtual void                DestroyBatch( const BatchHandle& handle ) = 0;
     // Checks if the handle and the batch at the handle are valid
     virtual bool                IsBatchValid( const BatchHandle& handle ) = 0;
+    // @returns How many instances the batch has
+    virtual uint32_t            GetBatchSize( const BatchHandle& handle ) = 0;
+    // @returns What the batch is made of
+    virtual BatchFormat         GetBatchFormat( const BatchHandle& handle ) = 0;
+
+    // @returns Memory usage and fragmentation of a GPU buffer arena
+    virtual GpuArenaStats       GetArenaStats( const GpuArena& arena ) const = 0;
+    // Fills in the draw, triangle, state change and upload counters of the last frame
+    virtual void                GetFrameCounters( FrameStats& stats ) const = 0;
+    // Gets the GPU time of an earlier frame, if it's known by now, without waiting for the GPU
+    // Call it until it returns false, the oldest frame comes first
+    // @param frameNumber: the frame it belongs to, counting BeginFrames from 0
+    // @returns false if there's no new GPU time yet
+    virtual bool                GetGpuFrameTime( uint64_t& frameNumber, float& milliseconds ) = 0;
 
 };
 
@@ -0,0 +1,200 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+
+// =====================================================================
+// JobSystem::Init
+// =====================================================================
+void JobSystem::Init( const int& numThreads )
+{
+    Shutdown();
+
+    uint32_t numWorkers = 0U;
+    if ( numThreads < 0 )
+    {
+        const uint32_t numCores = std::thread::hardware_concurrency();
+        numWorkers = numCores > 1U ? numCores - 1U : 0U;
+    }
+    else
+    {
+        numWorkers = numThreads;
+    }
+
+    quit = false;
+    for ( uint32_t i = 0U; i <= numWorkers; i++ )
+    {
+        queues.push_back( std::make_unique<JobQueue>() );
+    }
+
+    for ( uint32_t i = 0U; i < numWorkers; i++ )
+    {
+        workers.emplace_back( &JobSystem::WorkerLoop, this, i );
+    }
+}
+
+// =====================================================================
+// JobSystem::Shutdown
+// =====================================================================
+void JobSystem::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock( wakeMutex );
+        quit = true;
+    }
+    wakeCondition.notify_all();
+
+    for ( std::thread& worker : workers )
+    {
+        worker.join();
+    }
+
+    workers.clear();
+    queues.clear();
+}
+
+// =====================================================================
+// JobSystem::ParallelFor
+// =====================================================================
+void JobSystem::ParallelFor( const uint32_t& count, const uint32_t& grainSize, const JobFunction& function )
+{
+    const uint32_t numJobs = GetNumJobs( count, grainSize );
+    const uint32_t jobSize = std::max( grainSize, 1U );
+
+    // Not worth waking anyone up
+    if ( numJobs <= 1U || workers.empty() )
+    {
+        for ( uint32_t job = 0U; job < numJobs; job++ )
+        {
+            function( job * jobSize, std::min( (job + 1U) * jobSize, count ), job );
+        }
+        return;
+    }
+
+    currentFunction = &function;
+    jobsLeft.store( numJobs, std::memory_order_relaxed );
+
+    // Neighbouring jobs go to different threads, as neighbouring
+    // items tend to cost about the same
+    for ( uint32_t job = 0U; job < numJobs; job++ )
+    {
+        JobQueue& queue = *queues[job % queues.size()];
+        std::lock_guard<std::mutex> lock( queue.mutex );
+        queue.jobs.push_back( { job * jobSize, std::min( (job + 1U) * jobSize, count ), job } );
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( wakeMutex );
+        generation++;
+    }
+    wakeCondition.notify_all();
+
+    // Help out, then wait for the jobs that are still running elsewhere
+    const uint32_t ownQueue = queues.size() - 1U;
+    while ( RunJob( ownQueue ) )
+    {
+    }
+
+    while ( jobsLeft.load( std::memory_order_acquire ) )
+    {
+        std::this_thread::yield();
+    }
+
+    currentFunction = nullptr;
+}
+
+// =====================================================================
+// JobSystem::GetNumJobs
+// =====================================================================
+uint32_t JobSystem::GetNumJobs( const uint32_t& count, const uint32_t& grainSize )
+{
+    const uint32_t jobSize = std::max( grainSize, 1U );
+    return (count + jobSize - 1U) / jobSize;
+}
+
+// =====================================================================
+// JobSystem::WorkerLoop
+// =====================================================================
+void JobSystem::WorkerLoop( const uint32_t& queueIndex )
+{
+    uint64_t lastGeneration = 0U;
+    while ( true )
+    {
+        {
+            std::unique_lock<std::mutex> lock( wakeMutex );
+            wakeCondition.wait( lock, [&]() { return quit || generation != lastGeneration; } );
+            if ( quit )
+            {
+                return;
+            }
+
+            lastGeneration = generation;
+        }
+
+        while ( RunJob( queueIndex ) )
+        {
+        }
+    }
+}
+
+// =====================================================================
+// JobSystem::RunJob
+// =====================================================================
+bool JobSystem::RunJob( const uint32_t& queueIndex )
+{
+    Job job;
+    bool found = false;
+
+    // Own queue first, newest job first, it's the likeliest to be in cache
+    {
+        JobQueue& queue = *queues[queueIndex];
+        std::lock_guard<std::mutex> lock( queue.mutex );
+        if ( !queue.jobs.empty() )
+        {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+            found = true;
+        }
+    }
+
+    // Then steal the oldest job of whoever still has some
+    for ( uint32_t i = 1U; !found && i < queues.size(); i++ )
+    {
+        JobQueue& victim = *queues[(queueIndex + i) % queues.size()];
+        std::lock_guard<std::mutex> lock( victim.mutex );
+        if ( !victim.jobs.empty() )
+        {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            found = true;
+        }
+    }
+
+    if ( !found )
+    {
+        return false;
+    }
+
+    (*currentFunction)( job.first, job.last, job.index );
+    jobsLeft.fetch_sub( 1U, std::memory_order_acq_rel );
+    return true;
+}
+
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
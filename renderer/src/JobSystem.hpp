@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// =====================================================================
+// JobSystem
+// 
+// A small thread pool for data-parallel work within a frame. ParallelFor
+// splits a range of items into jobs and spreads them over one queue per
+// thread. Every thread takes jobs from the back of its own queue, and
+// once that runs dry, steals from the front of the others' queues, so
+// uneven jobs still keep every thread busy. The thread that calls
+// ParallelFor works on the jobs too, instead of just waiting
+// =====================================================================
+class JobSystem final
+{
+public:
+    // @param first, last: the job's range of items, [first, last)
+    // @param jobIndex: from 0 to GetNumJobs() - 1, the same for the same range every time
+    using JobFunction = std::function<void( uint32_t first, uint32_t last, uint32_t jobIndex )>;
+
+    // @param numThreads: how many worker threads to start, below 0 for one less than the number of CPU cores
+    void                Init( const int& numThreads = -1 );
+    void                Shutdown();
+
+    // Splits [0, count) into jobs of grainSize items, runs them on all threads and
+    // returns once they're all done. Jobs must not call ParallelFor themselves
+    void                ParallelFor( const uint32_t& count, const uint32_t& grainSize, const JobFunction& function );
+
+    // @returns How many jobs ParallelFor splits count items into
+    static uint32_t     GetNumJobs( const uint32_t& count, const uint32_t& grainSize );
+    // @returns The worker threads plus the calling thread
+    uint32_t            GetNumThreads() const { return workers.size() + 1U; }
+
+private:
+    struct Job
+    {
+        uint32_t        first;
+        uint32_t        last;
+        uint32_t        index;
+    };
+
+    struct JobQueue
+    {
+        std::mutex      mutex;
+        std::deque<Job> jobs;
+    };
+
+    void                WorkerLoop( const uint32_t& queueIndex );
+    // Runs a job from the back of its own queue, or from the front of another queue
+    // @returns false if there was nothing left anywhere
+    bool                RunJob( const uint32_t& queueIndex );
+
+    std::vector<std::thread> workers;
+    // One per worker, the last one is the calling thread's
+    std::vector<std::unique_ptr<JobQueue>> queues;
+
+    // Workers sleep on this between ParallelFors
+    std::mutex          wakeMutex;
+    std::condition_variable wakeCondition;
+    // Bumped by every ParallelFor, so the workers know there's new work
+    uint64_t            generation{ 0U };
+    bool                quit{ false };
+
+    // Only valid while a ParallelFor is running
+    const JobFunction*  currentFunction{ nullptr };
+    std::atomic<uint32_t> jobsLeft{ 0U };
+};
+
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
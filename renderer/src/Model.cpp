@@ -306,6 +306,25 @@ bool Model::Okay() const
 	return okay;
 }
 
+// =====================================================================
+// Model::CalculateBounds
+// =====================================================================
+void Model::CalculateBounds()
+{
+	if ( mesh.vertices.empty() )
+	{
+		mins = maxs = glm::vec3( 0.0f );
+		return;
+	}
+
+	mins = maxs = mesh.vertices[0].position;
+	for ( const DrawVertex& vertex : mesh.vertices )
+	{
+		mins = glm::min( mins, vertex.position );
+		maxs = glm::max( maxs, vertex.position );
+	}
+}
+
 /*
 Copyright (c) 2021 Admer456
 
@@ -12,10 +12,15 @@ class Model final
 public:
     void        LoadFromPath( const char* filePath );
     bool        Okay() const;
+    // Fits mins and maxs around the mesh's vertices
+    void        CalculateBounds();
 
     bool        okay{ false };
     std::string name;
     DrawMesh    mesh;
+    // Model-space bounding box
+    glm::vec3   mins{ 0.0f };
+    glm::vec3   maxs{ 0.0f };
 };
 
 /*
@@ -0,0 +1,540 @@
+#include "IRenderWorld.hpp"
+#include "OffsetAllocator.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    uint32_t CountLeadingZeroes( const uint32_t& value )
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        return _BitScanReverse( &index, value ) ? 31U - index : 32U;
+#else
+        return value ? __builtin_clz( value ) : 32U;
+#endif
+    }
+
+    uint32_t CountTrailingZeroes( const uint32_t& value )
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        return _BitScanForward( &index, value ) ? index : 32U;
+#else
+        return value ? __builtin_ctz( value ) : 32U;
+#endif
+    }
+
+    // @returns The index of the lowest set bit at or above startBit, NoSpace if there's none
+    uint32_t FindLowestSetBitAfter( const uint32_t& bitMask, const uint32_t& startBit )
+    {
+        if ( startBit >= 32U )
+        {
+            return OffsetAllocator::NoSpace;
+        }
+
+        const uint32_t maskAfterStart = bitMask & ~((1U << startBit) - 1U);
+        if ( !maskAfterStart )
+        {
+            return OffsetAllocator::NoSpace;
+        }
+
+        return CountTrailingZeroes( maskAfterStart );
+    }
+
+    // Sizes are binned as tiny floats: 5 bits of exponent, 3 bits of mantissa
+    namespace SmallFloat
+    {
+        constexpr uint32_t MantissaBits = 3U;
+        constexpr uint32_t MantissaValue = 1U << MantissaBits;
+        constexpr uint32_t MantissaMask = MantissaValue - 1U;
+
+        // Allocations look for bins that are guaranteed to fit them
+        uint32_t UintToFloatRoundUp( const uint32_t& size )
+        {
+            uint32_t exponent = 0U;
+            uint32_t mantissa = 0U;
+
+            if ( size < MantissaValue )
+            {   // Denormalised, the value is stored as-is
+                mantissa = size;
+            }
+            else
+            {
+                const uint32_t highestSetBit = 31U - CountLeadingZeroes( size );
+                const uint32_t mantissaStartBit = highestSetBit - MantissaBits;
+                exponent = mantissaStartBit + 1U;
+                mantissa = (size >> mantissaStartBit) & MantissaMask;
+
+                const uint32_t lowBitsMask = (1U << mantissaStartBit) - 1U;
+                if ( size & lowBitsMask )
+                {
+                    mantissa++;
+                }
+            }
+
+            // Adding rather than OR-ing, so the mantissa can overflow into the exponent
+            return (exponent << MantissaBits) + mantissa;
+        }
+
+        // Free ranges go into the bins they're guaranteed to fill
+        uint32_t UintToFloatRoundDown( const uint32_t& size )
+        {
+            uint32_t exponent = 0U;
+            uint32_t mantissa = 0U;
+
+            if ( size < MantissaValue )
+            {
+                mantissa = size;
+            }
+            else
+            {
+                const uint32_t highestSetBit = 31U - CountLeadingZeroes( size );
+                const uint32_t mantissaStartBit = highestSetBit - MantissaBits;
+                exponent = mantissaStartBit + 1U;
+                mantissa = (size >> mantissaStartBit) & MantissaMask;
+            }
+
+            return (exponent << MantissaBits) | mantissa;
+        }
+    }
+}
+
+// =====================================================================
+// OffsetAllocator::ctor
+// =====================================================================
+OffsetAllocator::OffsetAllocator( const uint32_t& size, const uint32_t& maxAllocations )
+    : size( size ), maxAllocations( maxAllocations )
+{
+    Reset();
+}
+
+// =====================================================================
+// OffsetAllocator::Reset
+// =====================================================================
+void OffsetAllocator::Reset()
+{
+    freeStorage = 0U;
+    numFreeRegions = 0U;
+    usedBinsTop = 0U;
+    lastNode = Unused;
+
+    for ( uint8_t& bins : usedBins )
+    {
+        bins = 0U;
+    }
+
+    for ( uint32_t& binIndex : binIndices )
+    {
+        binIndex = Unused;
+    }
+
+    nodes.assign( maxAllocations, Node() );
+
+    // Popped from the back, so node 0 goes first
+    freeNodes.resize( maxAllocations );
+    for ( uint32_t i = 0U; i < maxAllocations; i++ )
+    {
+        freeNodes[i] = maxAllocations - i - 1U;
+    }
+
+    // Start with the whole thing as one free range
+    if ( size && maxAllocations )
+    {
+        lastNode = InsertNodeIntoBin( size, 0U );
+    }
+}
+
+// =====================================================================
+// OffsetAllocator::Grow
+// =====================================================================
+bool OffsetAllocator::Grow( const uint32_t& newSize )
+{
+    if ( newSize <= size || !CanGrow() )
+    {
+        return false;
+    }
+
+    uint32_t offset = size;
+    uint32_t extraSize = newSize - size;
+    uint32_t previousNode = lastNode;
+    size = newSize;
+
+    // Merge with the free range at the end, if there is one
+    if ( previousNode != Unused && !nodes[previousNode].used )
+    {
+        const Node& freeEnd = nodes[previousNode];
+        offset = freeEnd.dataOffset;
+        extraSize += freeEnd.dataSize;
+
+        const uint32_t freeEndIndex = previousNode;
+        previousNode = freeEnd.neighbourPrev;
+        RemoveNodeFromBin( freeEndIndex );
+    }
+
+    const uint32_t nodeIndex = InsertNodeIntoBin( extraSize, offset );
+    if ( previousNode != Unused )
+    {
+        nodes[nodeIndex].neighbourPrev = previousNode;
+        nodes[previousNode].neighbourNext = nodeIndex;
+    }
+
+    lastNode = nodeIndex;
+    return true;
+}
+
+// =====================================================================
+// OffsetAllocator::CanGrow
+// =====================================================================
+bool OffsetAllocator::CanGrow() const
+{
+    // A free range at the end is extended, its node is reused
+    if ( lastNode != Unused && !nodes[lastNode].used )
+    {
+        return true;
+    }
+
+    return !freeNodes.empty();
+}
+
+// =====================================================================
+// OffsetAllocator::Allocate
+// =====================================================================
+OffsetAllocator::Allocation OffsetAllocator::Allocate( const uint32_t& allocationSize )
+{
+    // Always keep one node around for the remainder of a split
+    if ( !allocationSize || freeNodes.size() < 2U )
+    {
+        return {};
+    }
+
+    // Round up, so any range in the chosen bin is big enough
+    const uint32_t minBinIndex = SmallFloat::UintToFloatRoundUp( allocationSize );
+    const uint32_t minTopBinIndex = minBinIndex >> TopBinsIndexShift;
+    const uint32_t minLeafBinIndex = minBinIndex & LeafBinsIndexMask;
+
+    uint32_t topBinIndex = minTopBinIndex;
+    uint32_t leafBinIndex = NoSpace;
+
+    // Look in the same top bin first
+    if ( usedBinsTop & (1U << topBinIndex) )
+    {
+        leafBinIndex = FindLowestSetBitAfter( usedBins[topBinIndex], minLeafBinIndex );
+    }
+
+    // Then in any of the bigger ones, where every leaf bin fits
+    if ( leafBinIndex == NoSpace )
+    {
+        topBinIndex = FindLowestSetBitAfter( usedBinsTop, minTopBinIndex + 1U );
+        if ( topBinIndex == NoSpace )
+        {
+            return {};
+        }
+
+        leafBinIndex = CountTrailingZeroes( usedBins[topBinIndex] );
+    }
+
+    const uint32_t binIndex = (topBinIndex << TopBinsIndexShift) | leafBinIndex;
+
+    // Take the first node out of the bin
+    const uint32_t nodeIndex = binIndices[binIndex];
+    Node& node = nodes[nodeIndex];
+    const uint32_t nodeTotalSize = node.dataSize;
+    node.dataSize = allocationSize;
+    node.used = true;
+
+    binIndices[binIndex] = node.binListNext;
+    if ( node.binListNext != Unused )
+    {
+        nodes[node.binListNext].binListPrev = Unused;
+    }
+    node.binListNext = Unused;
+
+    freeStorage -= nodeTotalSize;
+    numFreeRegions--;
+
+    if ( binIndices[binIndex] == Unused )
+    {
+        usedBins[topBinIndex] &= ~(1U << leafBinIndex);
+        if ( !usedBins[topBinIndex] )
+        {
+            usedBinsTop &= ~(1U << topBinIndex);
+        }
+    }
+
+    // Put the rest of the range back as a new free node
+    const uint32_t remainderSize = nodeTotalSize - allocationSize;
+    if ( remainderSize )
+    {
+        const uint32_t newNodeIndex = InsertNodeIntoBin( remainderSize, node.dataOffset + allocationSize );
+        Node& newNode = nodes[newNodeIndex];
+        Node& splitNode = nodes[nodeIndex];
+
+        if ( splitNode.neighbourNext != Unused )
+        {
+            nodes[splitNode.neighbourNext].neighbourPrev = newNodeIndex;
+        }
+        else
+        {
+            lastNode = newNodeIndex;
+        }
+
+        newNode.neighbourPrev = nodeIndex;
+        newNode.neighbourNext = splitNode.neighbourNext;
+        splitNode.neighbourNext = newNodeIndex;
+    }
+
+    return { nodes[nodeIndex].dataOffset, nodeIndex };
+}
+
+// =====================================================================
+// OffsetAllocator::Free
+// =====================================================================
+void OffsetAllocator::Free( const Allocation& allocation )
+{
+    if ( allocation.metadata == NoSpace || allocation.metadata >= maxAllocations )
+    {
+        return;
+    }
+
+    const uint32_t nodeIndex = allocation.metadata;
+    Node& node = nodes[nodeIndex];
+    if ( !node.used )
+    {
+        return;
+    }
+
+    uint32_t offset = node.dataOffset;
+    uint32_t freedSize = node.dataSize;
+
+    // Merge with the free neighbour before
+    if ( node.neighbourPrev != Unused && !nodes[node.neighbourPrev].used )
+    {
+        const uint32_t prevIndex = node.neighbourPrev;
+        const Node& prevNode = nodes[prevIndex];
+        offset = prevNode.dataOffset;
+        freedSize += prevNode.dataSize;
+        node.neighbourPrev = prevNode.neighbourPrev;
+        RemoveNodeFromBin( prevIndex );
+    }
+
+    // And the free neighbour after
+    if ( node.neighbourNext != Unused && !nodes[node.neighbourNext].used )
+    {
+        const uint32_t nextIndex = node.neighbourNext;
+        const Node& nextNode = nodes[nextIndex];
+        freedSize += nextNode.dataSize;
+        node.neighbourNext = nextNode.neighbourNext;
+        RemoveNodeFromBin( nextIndex );
+    }
+
+    const uint32_t neighbourNext = node.neighbourNext;
+    const uint32_t neighbourPrev = node.neighbourPrev;
+
+    node = Node();
+    freeNodes.push_back( nodeIndex );
+
+    // The merged range gets a fresh node
+    const uint32_t combinedNodeIndex = InsertNodeIntoBin( freedSize, offset );
+    Node& combinedNode = nodes[combinedNodeIndex];
+
+    if ( neighbourNext != Unused )
+    {
+        combinedNode.neighbourNext = neighbourNext;
+        nodes[neighbourNext].neighbourPrev = combinedNodeIndex;
+    }
+    else
+    {
+        lastNode = combinedNodeIndex;
+    }
+
+    if ( neighbourPrev != Unused )
+    {
+        combinedNode.neighbourPrev = neighbourPrev;
+        nodes[neighbourPrev].neighbourNext = combinedNodeIndex;
+    }
+}
+
+// =====================================================================
+// OffsetAllocator::GetAllocationSize
+// =====================================================================
+uint32_t OffsetAllocator::GetAllocationSize( const Allocation& allocation ) const
+{
+    if ( allocation.metadata == NoSpace || allocation.metadata >= maxAllocations )
+    {
+        return 0U;
+    }
+
+    return nodes[allocation.metadata].dataSize;
+}
+
+// =====================================================================
+// OffsetAllocator::GetLastAllocation
+// =====================================================================
+OffsetAllocator::Allocation OffsetAllocator::GetLastAllocation() const
+{
+    uint32_t nodeIndex = lastNode;
+
+    // Free neighbours are always merged, so there's at most one free node to skip
+    if ( nodeIndex != Unused && !nodes[nodeIndex].used )
+    {
+        nodeIndex = nodes[nodeIndex].neighbourPrev;
+    }
+
+    if ( nodeIndex == Unused )
+    {
+        return {};
+    }
+
+    return { nodes[nodeIndex].dataOffset, nodeIndex };
+}
+
+// =====================================================================
+// OffsetAllocator::IsCompact
+// =====================================================================
+bool OffsetAllocator::IsCompact() const
+{
+    if ( !numFreeRegions )
+    {
+        return true;
+    }
+
+    return numFreeRegions == 1U && !nodes[lastNode].used;
+}
+
+// =====================================================================
+// OffsetAllocator::GetStorageReport
+// =====================================================================
+OffsetAllocator::StorageReport OffsetAllocator::GetStorageReport() const
+{
+    StorageReport report;
+    report.totalFreeSpace = freeStorage;
+    report.numFreeRegions = numFreeRegions;
+    // Every node is either a free region or an allocation
+    report.numAllocations = maxAllocations - freeNodes.size() - numFreeRegions;
+
+    // The biggest free range is somewhere in the highest non-empty bin
+    if ( usedBinsTop )
+    {
+        const uint32_t topBinIndex = 31U - CountLeadingZeroes( usedBinsTop );
+        const uint32_t leafBinIndex = 31U - CountLeadingZeroes( usedBins[topBinIndex] );
+        uint32_t nodeIndex = binIndices[(topBinIndex << TopBinsIndexShift) | leafBinIndex];
+
+        while ( nodeIndex != Unused )
+        {
+            if ( nodes[nodeIndex].dataSize > report.largestFreeRegion )
+            {
+                report.largestFreeRegion = nodes[nodeIndex].dataSize;
+            }
+
+            nodeIndex = nodes[nodeIndex].binListNext;
+        }
+    }
+
+    return report;
+}
+
+// =====================================================================
+// OffsetAllocator::InsertNodeIntoBin
+// =====================================================================
+uint32_t OffsetAllocator::InsertNodeIntoBin( const uint32_t& nodeSize, const uint32_t& offset )
+{
+    // Round down, the node has to fill the whole bin
+    const uint32_t binIndex = SmallFloat::UintToFloatRoundDown( nodeSize );
+    const uint32_t topBinIndex = binIndex >> TopBinsIndexShift;
+    const uint32_t leafBinIndex = binIndex & LeafBinsIndexMask;
+
+    // First node in this bin, mark it as used
+    if ( binIndices[binIndex] == Unused )
+    {
+        usedBins[topBinIndex] |= 1U << leafBinIndex;
+        usedBinsTop |= 1U << topBinIndex;
+    }
+
+    // Put the node at the front of the bin's list
+    const uint32_t topNodeIndex = binIndices[binIndex];
+    const uint32_t nodeIndex = freeNodes.back();
+    freeNodes.pop_back();
+
+    Node& node = nodes[nodeIndex];
+    node = Node();
+    node.dataOffset = offset;
+    node.dataSize = nodeSize;
+    node.binListNext = topNodeIndex;
+
+    if ( topNodeIndex != Unused )
+    {
+        nodes[topNodeIndex].binListPrev = nodeIndex;
+    }
+    binIndices[binIndex] = nodeIndex;
+
+    freeStorage += nodeSize;
+    numFreeRegions++;
+
+    return nodeIndex;
+}
+
+// =====================================================================
+// OffsetAllocator::RemoveNodeFromBin
+// =====================================================================
+void OffsetAllocator::RemoveNodeFromBin( const uint32_t& nodeIndex )
+{
+    Node& node = nodes[nodeIndex];
+
+    if ( node.binListPrev != Unused )
+    {   // Somewhere in the middle of the list
+        nodes[node.binListPrev].binListNext = node.binListNext;
+        if ( node.binListNext != Unused )
+        {
+            nodes[node.binListNext].binListPrev = node.binListPrev;
+        }
+    }
+    else
+    {   // At the front of the list
+        const uint32_t binIndex = SmallFloat::UintToFloatRoundDown( node.dataSize );
+        const uint32_t topBinIndex = binIndex >> TopBinsIndexShift;
+        const uint32_t leafBinIndex = binIndex & LeafBinsIndexMask;
+
+        binIndices[binIndex] = node.binListNext;
+        if ( node.binListNext != Unused )
+        {
+            nodes[node.binListNext].binListPrev = Unused;
+        }
+
+        if ( binIndices[binIndex] == Unused )
+        {
+            usedBins[topBinIndex] &= ~(1U << leafBinIndex);
+            if ( !usedBins[topBinIndex] )
+            {
+                usedBinsTop &= ~(1U << topBinIndex);
+            }
+        }
+    }
+
+    freeStorage -= node.dataSize;
+    numFreeRegions--;
+
+    node = Node();
+    freeNodes.push_back( nodeIndex );
+}
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
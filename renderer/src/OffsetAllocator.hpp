@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vector>
+
+// =====================================================================
+// OffsetAllocator
+// 
+// Two-level segregated fit (TLSF) allocator of ranges within some
+// linear resource, e.g. a GPU buffer. It never touches the memory itself,
+// it only hands out offsets, so the units are up to the user (bytes,
+// vertices, indices...)
+// 
+// Free ranges are put into one of 256 bins, based on a small float
+// representation of their size (5-bit exponent, 3-bit mantissa). Two
+// levels of bitmasks tell which bins aren't empty, so finding a free range
+// big enough is a couple of bit scans. Freed ranges are merged with
+// their free neighbours right away. Both Allocate and Free are O(1)
+// =====================================================================
+class OffsetAllocator final
+{
+public:
+    static constexpr uint32_t NoSpace = ~0U;
+
+    struct Allocation
+    {
+        uint32_t offset{ NoSpace };
+        // Node index, needed to free the allocation
+        uint32_t metadata{ NoSpace };
+
+        bool IsValid() const { return offset != NoSpace; }
+    };
+
+    struct StorageReport
+    {
+        uint32_t totalFreeSpace{ 0U };
+        uint32_t largestFreeRegion{ 0U };
+        uint32_t numFreeRegions{ 0U };
+        uint32_t numAllocations{ 0U };
+    };
+
+    // @param size: total size of the managed resource
+    // @param maxAllocations: how many ranges (used and free) can exist at once
+    // A default-constructed allocator has no room for anything
+    OffsetAllocator( const uint32_t& size = 0U, const uint32_t& maxAllocations = 0U );
+
+    // Forgets all allocations
+    void            Reset();
+    // Adds more space at the end, e.g. after the resource was resized
+    // The new space needs a node of its own, so check CanGrow before resizing the resource
+    // @returns false if nothing was added
+    bool            Grow( const uint32_t& newSize );
+    bool            CanGrow() const;
+
+    // @returns An invalid allocation if there's no free range big enough
+    Allocation      Allocate( const uint32_t& size );
+    void            Free( const Allocation& allocation );
+
+    uint32_t        GetAllocationSize( const Allocation& allocation ) const;
+    // @returns The allocation with the highest offset, invalid if nothing is allocated
+    Allocation      GetLastAllocation() const;
+    // @returns true if all the free space is in one range at the very end
+    bool            IsCompact() const;
+    // @returns true if Allocate fails because all the nodes are taken, however much space is free
+    bool            IsOutOfNodes() const { return freeNodes.size() < 2U; }
+
+    uint32_t        GetSize() const { return size; }
+    StorageReport   GetStorageReport() const;
+
+private:
+    static constexpr uint32_t NumTopBins = 32U;
+    static constexpr uint32_t BinsPerLeaf = 8U;
+    static constexpr uint32_t TopBinsIndexShift = 3U;
+    static constexpr uint32_t LeafBinsIndexMask = 0x7U;
+    static constexpr uint32_t NumLeafBins = NumTopBins * BinsPerLeaf;
+    static constexpr uint32_t Unused = ~0U;
+
+    struct Node
+    {
+        uint32_t dataOffset{ 0U };
+        uint32_t dataSize{ 0U };
+        // Doubly linked list of free nodes in the same bin
+        uint32_t binListPrev{ Unused };
+        uint32_t binListNext{ Unused };
+        // Doubly linked list of nodes in memory order
+        uint32_t neighbourPrev{ Unused };
+        uint32_t neighbourNext{ Unused };
+        bool     used{ false };
+    };
+
+    // @returns The new free node's index
+    uint32_t        InsertNodeIntoBin( const uint32_t& size, const uint32_t& offset );
+    void            RemoveNodeFromBin( const uint32_t& nodeIndex );
+
+    uint32_t        size;
+    uint32_t        maxAllocations;
+    uint32_t        freeStorage{ 0U };
+    uint32_t        numFreeRegions{ 0U };
+    // The node at the end of the resource, used or not
+    uint32_t        lastNode{ Unused };
+
+    uint32_t        usedBinsTop{ 0U };
+    uint8_t         usedBins[NumTopBins]{};
+    uint32_t        binIndices[NumLeafBins]{};
+
+    std::vector<Node> nodes;
+    // Stack of unused node indices
+    std::vector<uint32_t> freeNodes;
+};
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <glm/gtc/matrix_transform.hpp>
+
 // =====================================================================
 // RenderEntity
 // 
@@ -8,10 +10,84 @@
 class RenderEntity
 {
 public:
+    RenderEntity() = default;
+    // @param entityModel: the model the params refer to, nullptr if there is none
+    RenderEntity( const RenderEntityParams& entityParams, const Model* entityModel )
+        : params( entityParams )
+    {
+        CalculateTransform( entityModel );
+    }
+
+    // Copies the params over, but only recalculates the world matrix
+    // and bounds if the position, orientation or model changed
+    // @param entityModel: the model the new params refer to, nullptr if there is none
+    // @returns true if the transform was recalculated
+    bool                Update( const RenderEntityParams& newParams, const Model* entityModel )
+    {
+        const bool transformChanged = params.position != newParams.position
+                                   || params.orientation != newParams.orientation
+                                   || params.model != newParams.model;
+
+        params = newParams;
+        if ( transformChanged )
+        {
+            CalculateTransform( entityModel );
+        }
+
+        return transformChanged;
+    }
+
+    // Puts the entity into its parent's space, or back into world space
+    // @param parentMatrix: world matrix of the parent, nullptr if there is none
+    // @param entityModel: the model the params refer to, nullptr if there is none
+    void                ApplyParentTransform( const glm::mat4* parentMatrix, const Model* entityModel )
+    {
+        worldMatrix = (nullptr != parentMatrix) ? (*parentMatrix * localMatrix) : localMatrix;
+        CalculateBounds( entityModel );
+    }
+
     // Parameters that matter to the renderer
     RenderEntityParams  params;
-    // Backend-specific objects for batch rendering
-    BatchHandle         batchID{ BatchInvalid };
+    // Relative to the parent, same as worldMatrix if there is no parent
+    glm::mat4           localMatrix{ 1.0f };
+    // Model space to world space, cached so it isn't rebuilt for every surface draw
+    glm::mat4           worldMatrix{ 1.0f };
+    // World-space bounding box around the model
+    glm::vec3           worldMins{ 0.0f };
+    glm::vec3           worldMaxs{ 0.0f };
+
+private:
+    // Entities with a parent get their world matrix from ApplyParentTransform afterwards
+    void                CalculateTransform( const Model* entityModel )
+    {
+        // Move the model then rotate, orientation contains angles & scale
+        localMatrix = glm::translate( glm::identity<glm::mat4>(), params.position ) * params.orientation;
+        worldMatrix = localMatrix;
+        CalculateBounds( entityModel );
+    }
+
+    void                CalculateBounds( const Model* entityModel )
+    {
+        if ( nullptr == entityModel )
+        {
+            worldMins = worldMaxs = glm::vec3( worldMatrix[3] );
+            return;
+        }
+
+        // Transform the box's centre, then fit the rotated extents into a new box
+        const glm::vec3 centre = (entityModel->mins + entityModel->maxs) * 0.5f;
+        const glm::vec3 extents = (entityModel->maxs - entityModel->mins) * 0.5f;
+        const glm::vec3 worldCentre = glm::vec3( worldMatrix * glm::vec4( centre, 1.0f ) );
+
+        glm::vec3 worldExtents{ 0.0f };
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+            worldExtents += glm::abs( glm::vec3( worldMatrix[axis] ) ) * extents[axis];
+        }
+
+        worldMins = worldCentre - worldExtents;
+        worldMaxs = worldCentre + worldExtents;
+    }
 };
 
 /*
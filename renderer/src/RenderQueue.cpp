@@ -0,0 +1,198 @@
+#include "IRenderWorld.hpp"
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+
+// =====================================================================
+// DrawKey::Make
+// =====================================================================
+uint64_t DrawKey::Make( uint8_t pass, uint32_t shader, uint16_t shaderFlags, uint32_t material,
+                        RenderModelHandle model, uint32_t surface, float depth )
+{
+    // Quantise the depth
+    float normalisedDepth = std::clamp( depth / DepthRange, 0.0f, 1.0f );
+    uint64_t quantisedDepth = static_cast<uint64_t>( normalisedDepth * Mask( DepthBits ) );
+
+    // Transparent surfaces are drawn back-to-front
+    if ( pass == RenderPass_Transparent )
+    {
+        quantisedDepth = Mask( DepthBits ) - quantisedDepth;
+    }
+
+    const uint64_t vertexArray = ((model & Mask( ModelBits )) << SurfaceBits) | (surface & Mask( SurfaceBits ));
+    // ShaderFlag_Normal is always there, so it doesn't need a bit
+    const uint64_t flags = shaderFlags >> 1U;
+
+    return ((pass & Mask( PassBits )) << PassShift)
+        | ((shader & Mask( ShaderBits )) << ShaderShift)
+        | ((flags & Mask( ShaderFlagsBits )) << ShaderFlagsShift)
+        | ((material & Mask( MaterialBits )) << MaterialShift)
+        | (vertexArray << VertexArrayShift)
+        | (quantisedDepth << DepthShift);
+}
+
+// =====================================================================
+// RenderQueue::Clear
+// =====================================================================
+void RenderQueue::Clear()
+{
+    packets.clear();
+}
+
+// =====================================================================
+// RenderQueue::Add
+// =====================================================================
+void RenderQueue::Add( const DrawPacket& packet )
+{
+    packets.push_back( packet );
+}
+
+// =====================================================================
+// RenderQueue::Append
+// =====================================================================
+void RenderQueue::Append( const std::vector<DrawPacket>& newPackets )
+{
+    packets.insert( packets.end(), newPackets.begin(), newPackets.end() );
+}
+
+// =====================================================================
+// RenderQueue::PrepareBuckets
+// =====================================================================
+void RenderQueue::PrepareBuckets( const uint32_t& numBuckets )
+{
+    if ( buckets.size() < numBuckets )
+    {
+        buckets.resize( numBuckets );
+    }
+
+    for ( uint32_t i = 0U; i < numBuckets; i++ )
+    {
+        buckets[i].packets.clear();
+    }
+
+    numUsedBuckets = numBuckets;
+}
+
+// =====================================================================
+// RenderQueue::MergeBuckets
+// =====================================================================
+void RenderQueue::MergeBuckets()
+{
+    size_t total = packets.size();
+    for ( uint32_t i = 0U; i < numUsedBuckets; i++ )
+    {
+        total += buckets[i].packets.size();
+    }
+
+    packets.reserve( total );
+    for ( uint32_t i = 0U; i < numUsedBuckets; i++ )
+    {
+        const std::vector<DrawPacket>& bucket = buckets[i].packets;
+        packets.insert( packets.end(), bucket.begin(), bucket.end() );
+    }
+
+    numUsedBuckets = 0U;
+}
+
+// =====================================================================
+// RenderQueue::Sort
+// =====================================================================
+void RenderQueue::Sort()
+{
+    const size_t numPackets = packets.size();
+    if ( numPackets < 2U )
+    {
+        return;
+    }
+
+    // Build the histograms of all passes in one go
+    uint32_t histograms[RadixPasses][RadixSize]{};
+    for ( const DrawPacket& packet : packets )
+    {
+        for ( uint32_t pass = 0U; pass < RadixPasses; pass++ )
+        {
+            histograms[pass][(packet.key >> (pass * RadixBits)) & RadixMask]++;
+        }
+    }
+
+    sortBuffer.resize( numPackets );
+    for ( uint32_t pass = 0U; pass < RadixPasses; pass++ )
+    {
+        const uint32_t shift = pass * RadixBits;
+        uint32_t* histogram = histograms[pass];
+
+        // Every key has the same digit here, this pass wouldn't move anything
+        if ( histogram[(packets[0].key >> shift) & RadixMask] == numPackets )
+        {
+            continue;
+        }
+
+        // Turn the counts into offsets
+        uint32_t offset = 0U;
+        for ( uint32_t digit = 0U; digit < RadixSize; digit++ )
+        {
+            const uint32_t count = histogram[digit];
+            histogram[digit] = offset;
+            offset += count;
+        }
+
+        // Scatter, this is stable so the previous passes are preserved
+        for ( const DrawPacket& packet : packets )
+        {
+            sortBuffer[histogram[(packet.key >> shift) & RadixMask]++] = packet;
+        }
+
+        packets.swap( sortBuffer );
+    }
+}
+
+// =====================================================================
+// RenderQueue::GetShaderIndex
+// =====================================================================
+uint32_t RenderQueue::GetShaderIndex( const IShader* shader )
+{
+    auto iter = shaderIndices.find( shader );
+    if ( iter != shaderIndices.end() )
+    {
+        return iter->second;
+    }
+
+    const uint32_t index = shaderIndices.size();
+    shaderIndices[shader] = index;
+    return index;
+}
+
+// =====================================================================
+// RenderQueue::GetMaterialIndex
+// =====================================================================
+uint32_t RenderQueue::GetMaterialIndex( const IMaterial* material )
+{
+    auto iter = materialIndices.find( material );
+    if ( iter != materialIndices.end() )
+    {
+        return iter->second;
+    }
+
+    const uint32_t index = materialIndices.size();
+    materialIndices[material] = index;
+    return index;
+}
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "IRenderWorld.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+class IShader;
+class IMaterial;
+
+// =====================================================================
+// RenderPass
+// 
+// The pass is the most significant part of a draw key, so all
+// opaque surfaces are drawn before all transparent ones
+// =====================================================================
+enum RenderPass : uint8_t
+{
+    // Sorted by state, then front-to-back
+    RenderPass_Opaque = 0,
+    // Sorted by state, then back-to-front
+    RenderPass_Transparent,
+
+    RenderPass_MAX
+};
+
+// =====================================================================
+// DrawKey
+// 
+// 64-bit sort key of a draw packet. From the most significant bit down:
+// | pass: 2 | shader: 8 | shader flags: 4 | material: 14 | vertex array: 20 | depth: 16 |
+// 
+// Sorting by this key groups draws by shader permutation, then by material,
+// then by vertex array, so state changes between draws are minimal
+// =====================================================================
+struct DrawKey
+{
+    static constexpr uint64_t DepthBits = 16U;
+    static constexpr uint64_t VertexArrayBits = 20U;
+    static constexpr uint64_t MaterialBits = 14U;
+    static constexpr uint64_t ShaderFlagsBits = 4U;
+    static constexpr uint64_t ShaderBits = 8U;
+    static constexpr uint64_t PassBits = 2U;
+
+    static constexpr uint64_t DepthShift = 0U;
+    static constexpr uint64_t VertexArrayShift = DepthShift + DepthBits;
+    static constexpr uint64_t MaterialShift = VertexArrayShift + VertexArrayBits;
+    static constexpr uint64_t ShaderFlagsShift = MaterialShift + MaterialBits;
+    static constexpr uint64_t ShaderShift = ShaderFlagsShift + ShaderFlagsBits;
+    static constexpr uint64_t PassShift = ShaderShift + ShaderBits;
+
+    static_assert(PassShift + PassBits == 64U, "DrawKey fields must add up to 64 bits!");
+
+    // A vertex array is identified by its model and the surface within it
+    static constexpr uint64_t SurfaceBits = 6U;
+    static constexpr uint64_t ModelBits = VertexArrayBits - SurfaceBits;
+
+    // Anything further than this from the camera gets the maximum depth
+    // Should match the far plane of the render backend
+    static constexpr float    DepthRange = 8192.0f;
+
+    // @param pass: RenderPass_Opaque etc.
+    // @param shader: shader index from RenderQueue::GetShaderIndex
+    // @param shaderFlags: the shader permutation, i.e. ShaderFlag_Instanced etc., without ShaderFlag_Normal it fits in 4 bits
+    // @param material: material index from RenderQueue::GetMaterialIndex
+    // @param model: the model's handle
+    // @param surface: surface ID within the model
+    // @param depth: distance between the camera and the render entity
+    static uint64_t Make( uint8_t pass, uint32_t shader, uint16_t shaderFlags, uint32_t material,
+                          RenderModelHandle model, uint32_t surface, float depth );
+
+    static constexpr uint64_t Mask( const uint64_t& bits )
+    {
+        return (uint64_t( 1U ) << bits) - 1U;
+    }
+};
+
+// =====================================================================
+// DrawPacket
+// 
+// A single render entity surface, along with its batch, waiting in
+// the render queue to be drawn
+// =====================================================================
+struct DrawPacket
+{
+    uint64_t            key;
+    RenderEntityHandle  entity;
+    uint16_t            surface;
+    BatchHandle         batch;
+    uint32_t            batchSize;
+};
+
+// =====================================================================
+// RenderQueue
+// 
+// Collects draw packets during a frame and radix sorts them by key,
+// before they're submitted to the render backend
+// 
+// Packets can also be collected by several jobs at once, each into its
+// own bucket, and merged into the queue before sorting
+// =====================================================================
+class RenderQueue final
+{
+public:
+    // Removes all packets, keeps the memory
+    void                Clear();
+    // Adds a packet to the end of the queue
+    void                Add( const DrawPacket& packet );
+    // Adds packets to the end of the queue, e.g. ones kept from an earlier frame
+    void                Append( const std::vector<DrawPacket>& newPackets );
+    // Empties the buckets and makes sure there are at least this many, keeps the memory
+    void                PrepareBuckets( const uint32_t& numBuckets );
+    // Not synchronised, every job has to fill its own bucket
+    std::vector<DrawPacket>& GetBucket( const uint32_t& index )
+    {
+        return buckets[index].packets;
+    }
+    // Appends the buckets to the queue in order, so the queue is the same
+    // as if one thread went through all the jobs one after another
+    void                MergeBuckets();
+    // LSD radix sort, 8 bits per pass, skipping passes where all keys share the same digit
+    void                Sort();
+
+    const std::vector<DrawPacket>& GetPackets() const
+    {
+        return packets;
+    }
+
+    // @returns A small index for this shader, to be used in draw keys
+    // Indices keep growing, draw keys only keep their low bits, so two shaders can
+    // end up with the same one there. Compare the shaders themselves when that matters
+    uint32_t            GetShaderIndex( const IShader* shader );
+    // @returns A small index for this material, to be used in draw keys
+    // Same as with shaders, it can wrap around in the key
+    uint32_t            GetMaterialIndex( const IMaterial* material );
+
+private:
+    static constexpr uint32_t RadixBits = 8U;
+    static constexpr uint32_t RadixSize = 1U << RadixBits;
+    static constexpr uint32_t RadixMask = RadixSize - 1U;
+    static constexpr uint32_t RadixPasses = 64U / RadixBits;
+
+    std::vector<DrawPacket> packets;
+    std::vector<DrawPacket> sortBuffer;
+
+    // Padded to a cache line, so jobs adding to neighbouring buckets don't slow each other down
+    struct alignas( 64 ) Bucket
+    {
+        std::vector<DrawPacket> packets;
+    };
+
+    std::vector<Bucket> buckets;
+    uint32_t            numUsedBuckets{ 0U };
+
+    std::unordered_map<const IShader*, uint32_t> shaderIndices;
+    std::unordered_map<const IMaterial*, uint32_t> materialIndices;
+};
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
@@ -3,9 +3,11 @@
 #include "Material.hpp"
 #include "RenderWorld.hpp"
 #include "IRenderer.hpp"
+#include "ScopedTimer.hpp"
 #include "stb_image.h"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 
 // =====================================================================
 // RenderWorld::Init
@@ -25,7 +27,29 @@ bool RenderWorld::Init( const RenderInitParams& params )
         return false;
     }
 
+    autoInstancingThreshold = params.autoInstancingThreshold;
+    useIndirectDrawing = params.useIndirectDrawing && backend->SupportsIndirectDrawing();
+    jobs.Init( params.numWorkerThreads );
+
     backend->Clear();
+
+    if ( params.hotReload )
+    {
+        fileWatcher.Start();
+        WatchShader( backend->GetDefaultShader() );
+    }
+
+    // Everything from here on goes through the render thread, which takes the context
+    if ( params.useRenderThread && params.makeContextCurrent && params.swapBuffers )
+    {
+        makeContextCurrent = params.makeContextCurrent;
+        swapBuffers = params.swapBuffers;
+        quitRenderThread = false;
+
+        makeContextCurrent( false );
+        renderThread = std::thread( &RenderWorld::RenderThreadLoop, this );
+    }
+
     return true;
 }
 
@@ -34,6 +58,26 @@ bool RenderWorld::Init( const RenderInitParams& params )
 // =====================================================================
 void RenderWorld::Shutdown()
 {
+    // Gives the context back to this thread
+    StopRenderThread();
+    jobs.Shutdown();
+
+    fileWatcher.Stop();
+    for ( const auto& reload : resourceReloads )
+    {
+        reload->loaded.wait();
+        stbi_image_free( reload->imageData );
+    }
+    resourceReloads.clear();
+    deferredChanges.clear();
+
+    // Their batches go away with the backend
+    staticGroups.clear();
+    staticGroupIndices.clear();
+    dirtyStaticGroups.clear();
+    staticPackets.clear();
+    staticPacketsVersion = ~0ULL;
+
     shaders.clear();
     textures.clear();
     materials.clear();
@@ -47,6 +91,85 @@ void RenderWorld::Shutdown()
     }
 }
 
+// =====================================================================
+// RenderWorld::NeedsRenderThread
+// =====================================================================
+bool RenderWorld::NeedsRenderThread() const
+{
+    return renderThread.joinable() && std::this_thread::get_id() != renderThread.get_id();
+}
+
+// =====================================================================
+// RenderWorld::RunOnRenderThread
+// =====================================================================
+uint64_t RenderWorld::RunOnRenderThread( std::function<void()> command, const bool& wait )
+{
+    std::unique_lock<std::mutex> lock( renderMutex );
+    renderCommands.push_back( std::move( command ) );
+    const uint64_t ticket = ++numCommandsQueued;
+    renderCondition.notify_all();
+
+    if ( wait )
+    {
+        renderCondition.wait( lock, [this, ticket]() { return numCommandsDone >= ticket; } );
+    }
+
+    return ticket;
+}
+
+// =====================================================================
+// RenderWorld::RenderThreadLoop
+// =====================================================================
+void RenderWorld::RenderThreadLoop()
+{
+    makeContextCurrent( true );
+
+    std::unique_lock<std::mutex> lock( renderMutex );
+    while ( true )
+    {
+        renderCondition.wait( lock, [this]() { return quitRenderThread || !renderCommands.empty(); } );
+
+        // Whatever was queued before quitting still gets done
+        if ( renderCommands.empty() )
+        {
+            break;
+        }
+
+        std::function<void()> command = std::move( renderCommands.front() );
+        renderCommands.pop_front();
+
+        lock.unlock();
+        command();
+        lock.lock();
+
+        numCommandsDone++;
+        renderCondition.notify_all();
+    }
+    lock.unlock();
+
+    makeContextCurrent( false );
+}
+
+// =====================================================================
+// RenderWorld::StopRenderThread
+// =====================================================================
+void RenderWorld::StopRenderThread()
+{
+    if ( !renderThread.joinable() )
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( renderMutex );
+        quitRenderThread = true;
+    }
+    renderCondition.notify_all();
+    renderThread.join();
+
+    makeContextCurrent( true );
+}
+
 // =====================================================================
 // RenderWorld::GetAPIName
 // =====================================================================
@@ -74,11 +197,26 @@ RenderEntityHandle RenderWorld::CreateEntity( const RenderEntityParams& params )
         if ( !ent.active )
         {
             // Construct the render entity
-            ent.re = RenderEntity{ params };
-            // For render batching
-            ent.re.batchID = GetBatchIndex( params );
+            ent.re = RenderEntity( params, GetModel( params.model ) );
             // So the entity can be rendered from now on
             ent.active = true;
+            ent.transformDirty = false;
+            // An update may still be queued from this slot's previous entity,
+            // that's fine, it'll just find the entity already linked
+            if ( CanBeGrouped( params ) )
+            {
+                JoinStaticGroup( i );
+            }
+            else
+            {
+                LinkEntity( i );
+            }
+
+            // Children get attached to their parent at the start of the frame, like any other reparenting
+            if ( params.parent != RenderHandleInvalid )
+            {
+                QueueUpdate( i );
+            }
             return i;
         }
 
@@ -103,28 +241,142 @@ bool RenderWorld::UpdateEntity( const RenderEntityHandle& handle, const RenderEn
         return false;
     }
 
-    if ( !entities.at( handle ).active || entities.at( handle ).temporary )
+    RenderEntitySlot& slot = entities[handle];
+    if ( !slot.active )
     {
         return false;
     }
 
-    entities.at( handle ).re.params = params;
+    // The world matrix and bounds only get recalculated if the entity moved
+    // Grouped entities also have their world matrix uploaded to their group's batch
+    const bool grouped = slot.staticGroup != NoStaticGroup;
+    const bool transformChanged = slot.re.Update( params, GetModel( params.model ) );
+    const bool inHierarchy = slot.linkedParent != RenderHandleInvalid || !slot.children.empty();
+    if ( transformChanged && (inHierarchy || grouped) )
+    {
+        slot.transformDirty = true;
+    }
+
+    // Other threads may be updating other entities right now, so the shared
+    // entity lists, static groups and the hierarchy are left alone, the entity gets moved to its
+    // new render layers, group or parent, and its children follow it, at the start of the next frame
+    if ( slot.linkedMask != params.renderMask || slot.linkedParent != params.parent || slot.transformDirty
+      || grouped != CanBeGrouped( params ) )
+    {
+        QueueUpdate( handle );
+    }
+
     return true;
 }
 
+// =====================================================================
+// RenderWorld::CreateBatch
+// =====================================================================
+BatchHandle RenderWorld::CreateBatch( const RenderBatchParam* params, const uint32_t& batchSize )
+{
+    return CreateBatch( params, batchSize, BatchFormat_Matrix );
+}
+
+BatchHandle RenderWorld::CreateBatch( const RenderBatchCompactParam* params, const uint32_t& batchSize )
+{
+    return CreateBatch( params, batchSize, BatchFormat_Compact );
+}
+
+BatchHandle RenderWorld::CreateBatch( const void* params, const uint32_t& batchSize, const BatchFormat& format )
+{
+    if ( nullptr == params || batchSize <= BatchSizeThreshold )
+    {
+        return BatchInvalid;
+    }
+
+    if ( NeedsRenderThread() )
+    {
+        BatchHandle handle = BatchInvalid;
+        RunOnRenderThread( [&]() { handle = CreateBatch( params, batchSize, format ); }, true );
+        return handle;
+    }
+
+    return backend->CreateBatch( params, batchSize, format );
+}
+
+// =====================================================================
+// RenderWorld::UpdateBatch
+// =====================================================================
+bool RenderWorld::UpdateBatch( const BatchHandle& handle, const RenderBatchParam* params, const uint32_t& first, const uint32_t& count )
+{
+    return UpdateBatch( handle, params, first, count, BatchFormat_Matrix );
+}
+
+bool RenderWorld::UpdateBatch( const BatchHandle& handle, const RenderBatchCompactParam* params, const uint32_t& first, const uint32_t& count )
+{
+    return UpdateBatch( handle, params, first, count, BatchFormat_Compact );
+}
+
+bool RenderWorld::UpdateBatch( const BatchHandle& handle, const void* params, const uint32_t& first, const uint32_t& count, const BatchFormat& format )
+{
+    if ( nullptr == params )
+    {
+        return false;
+    }
+
+    // Queued with a copy of the params, so the game doesn't have to wait for the frame
+    // that's being drawn. The handle and the format are only checked once it runs
+    if ( NeedsRenderThread() )
+    {
+        const size_t instanceSize = (format == BatchFormat_Compact) ? sizeof( RenderBatchCompactParam ) : sizeof( RenderBatchParam );
+        const uint8_t* bytes = static_cast<const uint8_t*>( params );
+        std::vector<uint8_t> copy( bytes, bytes + count * instanceSize );
+
+        RunOnRenderThread( [this, handle, copy, first, count, format]()
+        {
+            UpdateBatch( handle, copy.data(), first, count, format );
+        }, false );
+        return true;
+    }
+
+    if ( !backend->IsBatchValid( handle ) )
+    {
+        return false;
+    }
+
+    // The backend copies raw bytes, so the params have to be the same type as the batch's
+    if ( backend->GetBatchFormat( handle ) != format )
+    {
+        return false;
+    }
+
+    return backend->UpdateBatch( handle, params, first, count );
+}
+
+// =====================================================================
+// RenderWorld::DestroyBatch
+// =====================================================================
+void RenderWorld::DestroyBatch( const BatchHandle& handle )
+{
+    if ( NeedsRenderThread() )
+    {
+        RunOnRenderThread( [this, handle]() { DestroyBatch( handle ); }, false );
+        return;
+    }
+
+    backend->DestroyBatch( handle );
+}
+
 // =====================================================================
 // RenderWorld::CreateImmediateEntity
 // =====================================================================
 bool RenderWorld::CreateImmediateEntity( const RenderEntityParams& params )
 {
-    RenderModelHandle handle = CreateEntity( params );
-
-    if ( handle == RenderHandleInvalid )
+    // Each thread claims its own entry, so nothing else writes to it
+    const uint32_t index = numImmediateEntities.fetch_add( 1U, std::memory_order_relaxed );
+    if ( index >= MaxImmediateEntities )
     {
         return false;
     }
 
-    entities.at( handle ).temporary = true;
+    ImmediateEntity& ent = immediateEntities[index];
+    ent.re = RenderEntity( params, GetModel( params.model ) );
+    ent.published.store( true, std::memory_order_release );
     return true;
 }
 
@@ -133,8 +385,35 @@ bool RenderWorld::CreateImmediateEntity( const RenderEntityParams& params )
 // =====================================================================
 void RenderWorld::DestroyEntity( const RenderEntityHandle& handle )
 {
-    entities.at( handle ).active = false;
-    entities.at( handle ).temporary = false;
+    RenderEntitySlot& slot = entities.at( handle );
+    if ( slot.active )
+    {
+        if ( slot.staticGroup != NoStaticGroup )
+        {
+            LeaveStaticGroup( handle );
+        }
+        else
+        {
+            UnlinkEntity( handle );
+        }
+        SetParent( handle, RenderHandleInvalid );
+    }
+
+    // The children stay where they are in the world, and lose their parent,
+    // so they don't end up attached to whatever gets this slot next
+    for ( const RenderEntityHandle& child : slot.children )
+    {
+        RenderEntitySlot& childSlot = entities[child];
+        childSlot.linkedParent = RenderHandleInvalid;
+        childSlot.re.params.parent = RenderHandleInvalid;
+        childSlot.re.params.position = glm::vec3( childSlot.re.worldMatrix[3] );
+        childSlot.re.params.orientation = childSlot.re.worldMatrix;
+        childSlot.re.params.orientation[3] = glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f );
+        childSlot.re.localMatrix = childSlot.re.worldMatrix;
+    }
+
+    slot.children.clear();
+    slot.active = false;
 }
 
 // =====================================================================
@@ -142,6 +421,13 @@ void RenderWorld::DestroyEntity( const RenderEntityHandle& handle )
 // =====================================================================
 RenderModelHandle RenderWorld::CreateModel( const RenderModelParams& params )
 {
+    if ( NeedsRenderThread() )
+    {
+        RenderModelHandle handle = RenderHandleInvalid;
+        RunOnRenderThread( [&]() { handle = CreateModel( params ); }, true );
+        return handle;
+    }
+
     // Check if we got existing ones
     RenderModelHandle handle = 0;
     for ( handle = 0; handle < models.size(); handle++ )
@@ -160,6 +446,7 @@ RenderModelHandle RenderWorld::CreateModel( const RenderModelParams& params )
 
     if ( model.Okay() )
     {
+        model.CalculateBounds();
         for ( auto& surf : model.mesh.surfaces )
         {
             // Hardcoded texture paths for now...
@@ -167,7 +454,19 @@ RenderModelHandle RenderWorld::CreateModel( const RenderModelParams& params )
             surf.material = CreateMaterialSimple( defaultTexture );
         }
 
-        backend->CreateModel( params, &model.mesh );
+        // Model handles are the same in the backend, so nothing may be left behind here
+        if ( backend->CreateModel( params, &model.mesh ) == RenderHandleInvalid )
+        {
+            printf( "RenderWorld: cannot fit model '%s' into GPU memory\n", params.modelPath );
+            models.pop_back();
+            return RenderHandleInvalid;
+        }
+
+        if ( fileWatcher.IsRunning() )
+        {
+            fileWatcher.Watch( params.modelPath );
+        }
+
         return handle;
     }
 
@@ -178,9 +477,15 @@ RenderModelHandle RenderWorld::CreateModel( const RenderModelParams& params )
 // =====================================================================
 // RenderWorld::UpdateModel
 // =====================================================================
-void RenderWorld::UpdateModel( const RenderModelHandle& handle, const RenderModelParams& params )
+bool RenderWorld::UpdateModel( const RenderModelHandle& handle, const RenderModelParams& params )
 {
-
+    // The mesh belongs to the caller, so this has to wait
+    if ( NeedsRenderThread() )
+    {
+        bool updated = false;
+        RunOnRenderThread( [&]() { updated = UpdateModel( handle, params ); }, true );
+        return updated;
+    }
 
     return backend->UpdateModel( handle, params.mesh );
 }
@@ -190,6 +495,13 @@ void RenderWorld::UpdateModel( const RenderModelHandle& handle, const RenderMode
 // =====================================================================
 IMaterial* RenderWorld::CreateMaterialSimple( ITexture* diffuseImage )
 {
+    if ( NeedsRenderThread() )
+    {
+        IMaterial* material = nullptr;
+        RunOnRenderThread( [&]() { material = CreateMaterialSimple( diffuseImage ); }, true );
+        return material;
+    }
+
     for ( IMaterial* material : materials )
     {
         if ( !strcmp( material->GetName(), diffuseImage->GetName() ) )
@@ -228,6 +540,13 @@ void RenderWorld::ReloadMaterials()
 // =====================================================================
 ITexture* RenderWorld::LoadTexture( const char* path, TextureType type, uint16_t flags )
 {
+    if ( NeedsRenderThread() )
+    {
+        ITexture* texture = nullptr;
+        RunOnRenderThread( [&]() { texture = LoadTexture( path, type, flags ); }, true );
+        return texture;
+    }
+
     for ( auto& texture : textures )
     {
         if ( !strcmp( texture->GetName(), path ) )
@@ -246,6 +565,11 @@ ITexture* RenderWorld::LoadTexture( const char* path, TextureType type, uint16_t
         return nullptr;
     }
 
+    if ( fileWatcher.IsRunning() )
+    {
+        fileWatcher.Watch( path );
+    }
+
     textures.push_back( texture );
     return texture;
 }
@@ -256,6 +580,13 @@ ITexture* RenderWorld::LoadTexture( const char* path, TextureType type, uint16_t
 ITexture* RenderWorld::CreateTexture( const char* name, int width, int height,
                          TextureType type, uint16_t flags, byte* data )
 {
+    if ( NeedsRenderThread() )
+    {
+        ITexture* texture = nullptr;
+        RunOnRenderThread( [&]() { texture = CreateTexture( name, width, height, type, flags, data ); }, true );
+        return texture;
+    }
+
     for ( auto& texture : textures )
     {
         if ( !strcmp( texture->GetName(), name ) )
@@ -294,9 +625,22 @@ IShader* RenderWorld::LoadShader( const char* path )
 // =====================================================================
 void RenderWorld::ReloadShaders()
 {
+    if ( NeedsRenderThread() )
+    {
+        RunOnRenderThread( [this]() { ReloadShaders(); }, false );
+        return;
+    }
+
     for ( IShader* shader : shaders )
     {
-        shader->Reload();
+        if ( !shader->Reload() )
+        {
+            printf( "RenderWorld::ReloadShaders: cannot reload shader '%s', keeping the old one: %s\n",
+                    shader->GetName(), shader->GetErrorMessage() );
+            continue;
+        }
+
+        WatchShader( shader );
         printf( "%s\n",
             std::string( "RenderWorld::ReloadShaders: reloaded shader '" )
             .append( shader->GetName() )
@@ -305,6 +649,7 @@ void RenderWorld::ReloadShaders()
     }
 
     backend->ReloadShaders();
+    WatchShader( backend->GetDefaultShader() );
 }
 
 // =====================================================================
@@ -312,88 +657,1200 @@ void RenderWorld::ReloadShaders()
 // =====================================================================
 void RenderWorld::RenderFrame( const RenderView& view )
 {
-    backend->Clear();
-    backend->BeginFrame();
+    // The render thread is done with this snapshot since the last RenderFrame
+    FrameSnapshot& frame = snapshots[writeSnapshot];
+    frame.stats = FrameStats();
+
+    {
+        ScopedTimer timer( frame.stats.cpuTimes[FramePass_Update] );
+        // Reloaded resources are swapped in before anything of this frame is drawn
+        UpdateHotReload();
+        ApplyPendingUpdates();
+        UpdateStaticGroups();
+    }
+
+    {
+        ScopedTimer timer( frame.stats.cpuTimes[FramePass_Snapshot] );
+        TakeSnapshot( view, frame );
+    }
+
+    if ( !renderThread.joinable() )
+    {
+        DrawFrame( frame );
+    }
+    else
+    {
+        // Let the render thread finish the previous frame first, so it's never
+        // more than one frame behind, and so the other snapshot is free again
+        WaitForDrawnFrame();
+
+        const FrameSnapshot* snapshot = &frame;
+        lastFrameTicket = RunOnRenderThread( [this, snapshot]()
+        {
+            DrawFrame( *snapshot );
+            swapBuffers();
+        }, false );
+
+        writeSnapshot = (writeSnapshot + 1U) % snapshots.size();
+    }
+
+    // These were submitted by CreateImmediateEntity, remove them from the next frame
+    ClearImmediateEntities();
+}
+
+// =====================================================================
+// RenderWorld::WatchShader
+// =====================================================================
+void RenderWorld::WatchShader( IShader* shader )
+{
+    if ( !fileWatcher.IsRunning() || nullptr == shader )
+    {
+        return;
+    }
+
+    for ( uint32_t i = 0U; i < shader->GetNumDependencies(); i++ )
+    {
+        fileWatcher.Watch( shader->GetDependency( i ) );
+    }
+}
+
+// =====================================================================
+// RenderWorld::UpdateHotReload
+// =====================================================================
+void RenderWorld::UpdateHotReload()
+{
+    if ( !fileWatcher.IsRunning() )
+    {
+        return;
+    }
 
-    // TODO: Subviews
-    backend->SetRenderView( &view );
+    std::vector<std::string> changedFiles;
+    changedFiles.swap( deferredChanges );
+    fileWatcher.TakeChanges( changedFiles );
 
-    for ( auto& e : entities )
+    for ( const std::string& path : changedFiles )
     {
-        if ( e.active )
+        // Two reloads of the same thing could finish in the wrong order,
+        // so the second one has to wait until the first one is done
+        auto inProgress = std::find_if( resourceReloads.begin(), resourceReloads.end(),
+            [&path]( const std::shared_ptr<ResourceReload>& reload ) { return reload->path == path; } );
+        if ( inProgress != resourceReloads.end() )
+        {
+            deferredChanges.push_back( path );
+            continue;
+        }
+
+        auto reload = std::make_shared<ResourceReload>();
+        reload->path = path;
+
+        for ( ITexture* texture : textures )
         {
-            // Render all surfaces of the render entity's model
-            int batchSize = e.re.params.batchSize;
-            BatchHandle batchId = e.re.batchID;
-            
-            int numSurfaces = GetNumSurfacesForModel( e.re.params.model );
-            if ( numSurfaces == RenderHandleInvalid )
+            if ( FileWatcher::NormalisePath( texture->GetName() ) == path )
             {
-                continue;
+                reload->texture = texture;
+                break;
             }
+        }
 
-            // Invalid batches render as single instances
-            if ( !backend->IsBatchValid( batchId ) )
+        for ( RenderModelHandle handle = 0; handle < models.size() && nullptr == reload->texture; handle++ )
+        {
+            if ( FileWatcher::NormalisePath( models[handle].name ) == path )
             {
-                batchSize = 0;
-                batchId = BatchInvalid;
+                reload->model = handle;
+                break;
             }
+        }
+
+        // Shader files, those are taken care of by ApplyHotReload
+        if ( nullptr == reload->texture && reload->model == RenderHandleInvalid )
+        {
+            continue;
+        }
 
-            // All surfaces go through the rendering
-            // TODO: Material properties to not render under certain circumstances
-            for ( int i = 0; i < numSurfaces; i++ )
+        // The future waits for the thread when it's destroyed, so the
+        // thread only gets a plain pointer, or the reload would never be freed
+        ResourceReload* loading = reload.get();
+        reload->loaded = std::async( std::launch::async, [loading]()
+        {
+            if ( nullptr != loading->texture )
             {
-                backend->RenderSurfaceBatch( e.re.params, i, batchId, batchSize );
+                int channels = 0;
+                loading->imageData = stbi_load( loading->path.c_str(), &loading->width, &loading->height, &channels, 3 );
+                return;
             }
 
-            // This entity was rendered by CreateImmediateEntity, remove it from the next frame
-            if ( e.temporary )
+            loading->loadedModel.LoadFromPath( loading->path.c_str() );
+            if ( loading->loadedModel.Okay() )
             {
-                e.active = false;
-                e.temporary = false;
+                loading->loadedModel.CalculateBounds();
             }
+        } );
+
+        resourceReloads.push_back( reload );
+    }
+
+    std::vector<std::shared_ptr<ResourceReload>> finishedReloads;
+    bool modelsFinished = false;
+    for ( auto iter = resourceReloads.begin(); iter != resourceReloads.end(); )
+    {
+        if ( (*iter)->loaded.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+        {
+            iter++;
+            continue;
         }
+
+        modelsFinished |= (*iter)->model != RenderHandleInvalid;
+        finishedReloads.push_back( *iter );
+        iter = resourceReloads.erase( iter );
     }
 
-    backend->EndFrame();
-}
+    if ( changedFiles.empty() && finishedReloads.empty() )
+    {
+        return;
+    }
 
-// =====================================================================
-// RenderWorld::GetNumSurfacesForModel
-// =====================================================================
-uint32_t RenderWorld::GetNumSurfacesForModel( const RenderModelHandle& handle )
-{
-    if ( handle == RenderHandleInvalid || handle >= models.size() )
+    if ( !NeedsRenderThread() )
     {
-        return RenderHandleInvalid;
+        ApplyHotReload( changedFiles, finishedReloads );
+        return;
     }
 
-    return models.at( handle ).mesh.surfaces.size();
+    // Models and entity bounds are read on this thread too, so swapping models has to
+    // wait. Shaders and textures only need to be done before this frame is drawn
+    RunOnRenderThread( [this, changedFiles, finishedReloads]()
+    {
+        ApplyHotReload( changedFiles, finishedReloads );
+    }, modelsFinished );
 }
 
 // =====================================================================
-// RenderWorld::GetBatchIndex
+// RenderWorld::ApplyHotReload
 // =====================================================================
-BatchHandle RenderWorld::GetBatchIndex( const RenderEntityParams& params )
+void RenderWorld::ApplyHotReload( const std::vector<std::string>& changedFiles,
+                                  const std::vector<std::shared_ptr<ResourceReload>>& finishedReloads )
 {
-    if ( nullptr == params.batch || params.batchSize <= BatchSizeThreshold )
+    // Only the shaders that are made of one of these files, a shader only compiles in the
+    // background, and whatever uses it is drawn with the default shader until then
+    std::vector<IShader*> allShaders = shaders;
+    allShaders.push_back( backend->GetDefaultShader() );
+    for ( IShader* shader : allShaders )
     {
-        return BatchInvalid;
-    }
+        for ( uint32_t i = 0U; i < shader->GetNumDependencies(); i++ )
+        {
+            if ( std::find( changedFiles.begin(), changedFiles.end(), shader->GetDependency( i ) ) == changedFiles.end() )
+            {
+                continue;
+            }
 
-    auto batchIter = batches.find( &params );
-    if ( batchIter != batches.end() )
-    {
-        return batchIter->second;
+            // Broken by the edit, drawn as before until the next one fixes it
+            if ( !shader->Reload() )
+            {
+                printf( "RenderWorld: cannot reload shader '%s', keeping the old one: %s\n",
+                        shader->GetName(), shader->GetErrorMessage() );
+                break;
+            }
+
+            // It may include different files now
+            WatchShader( shader );
+            printf( "RenderWorld: reloaded shader '%s'\n", shader->GetName() );
+            break;
+        }
     }
 
-    BatchHandle handle = backend->CreateBatch( params.batch, params.batchSize );
-    if ( handle != BatchInvalid )
+    for ( const auto& reload : finishedReloads )
     {
-        batches[&params] = handle;
-    }
-    
-    return handle;
+        if ( nullptr != reload->texture )
+        {
+            if ( nullptr == reload->imageData )
+            {
+                printf( "RenderWorld: cannot reload texture '%s', keeping the old one\n", reload->path.c_str() );
+                continue;
+            }
+
+            // Same type and flags as before, only the image is new
+            ITexture* texture = reload->texture;
+            texture->LoadDirect( reload->width, reload->height, texture->GetTextureType(), texture->GetTextureFlags(), reload->imageData );
+            stbi_image_free( reload->imageData );
+            reload->imageData = nullptr;
+            printf( "RenderWorld: reloaded texture '%s'\n", reload->path.c_str() );
+            continue;
+        }
+
+        if ( !reload->loadedModel.Okay() )
+        {
+            printf( "RenderWorld: cannot reload model '%s', keeping the old one\n", reload->path.c_str() );
+            continue;
+        }
+
+        // Surfaces keep their materials, new ones get the same as in CreateModel
+        Model& model = models[reload->model];
+        auto& newSurfaces = reload->loadedModel.mesh.surfaces;
+        for ( size_t i = 0; i < newSurfaces.size(); i++ )
+        {
+            if ( i < model.mesh.surfaces.size() )
+            {
+                newSurfaces[i].material = model.mesh.surfaces[i].material;
+                continue;
+            }
+
+            ITexture* defaultTexture = LoadTexture( "metal1.png", TextureType_Albedo, DefaultTextureFlags );
+            newSurfaces[i].material = CreateMaterialSimple( defaultTexture );
+        }
+
+        // The vertex arrays only keep the materials, not the mesh, so it can still be moved afterwards
+        if ( !backend->UpdateModel( reload->model, &reload->loadedModel.mesh ) )
+        {
+            printf( "RenderWorld: cannot fit model '%s' into GPU memory, keeping the old one\n", reload->path.c_str() );
+            continue;
+        }
+
+        // Keep the name the game knows the model by
+        reload->loadedModel.name = model.name;
+        model = std::move( reload->loadedModel );
+
+        // The bounds of the entities using it are probably different now
+        for ( RenderEntitySlot& slot : entities )
+        {
+            if ( !slot.active || slot.re.params.model != reload->model )
+            {
+                continue;
+            }
+
+            const glm::mat4* parentMatrix = nullptr;
+            if ( slot.linkedParent != RenderHandleInvalid )
+            {
+                parentMatrix = &entities[slot.linkedParent].re.worldMatrix;
+            }
+
+            slot.re.ApplyParentTransform( parentMatrix, &model );
+        }
+
+        printf( "RenderWorld: reloaded model '%s'\n", reload->path.c_str() );
+    }
+}
+
+// =====================================================================
+// RenderWorld::TakeSnapshot
+// =====================================================================
+void RenderWorld::TakeSnapshot( const RenderView& view, FrameSnapshot& frame )
+{
+    frame.view = view;
+
+    // Entities without a render mask show up in every view
+    visibleEntities.clear();
+    visibleEntities.insert( visibleEntities.end(), unmaskedEntities.begin(), unmaskedEntities.end() );
+
+    // A view without a render mask sees every layer
+    const uint32_t viewMask = view.renderMask ? static_cast<uint32_t>( view.renderMask ) : ~0U;
+    for ( uint32_t bit = 0U; bit < RenderMaskBits; bit++ )
+    {
+        const uint32_t bitMask = 1U << bit;
+        if ( !(viewMask & bitMask) )
+        {
+            continue;
+        }
+
+        for ( const RenderEntityHandle& handle : maskedEntities[bit] )
+        {
+            // Entities on several layers are in several lists, so only
+            // draw them from the lowest bit this view can see
+            const uint32_t entityMask = static_cast<uint32_t>( entities[handle].linkedMask );
+            if ( entityMask & viewMask & (bitMask - 1U) )
+            {
+                continue;
+            }
+
+            visibleEntities.push_back( handle );
+        }
+    }
+
+    // Immediate entities, only the published ones are fully written
+    const uint32_t numImmediate = std::min( numImmediateEntities.load( std::memory_order_relaxed ), MaxImmediateEntities );
+    std::vector<const RenderEntity*> visibleImmediates;
+    for ( uint32_t i = 0U; i < numImmediate; i++ )
+    {
+        ImmediateEntity& ent = immediateEntities[i];
+        if ( !ent.published.load( std::memory_order_acquire ) )
+        {
+            continue;
+        }
+
+        // The hierarchy is up to date by now, so immediate entities can follow their parent too
+        const RenderEntityHandle& parent = ent.re.params.parent;
+        if ( parent < entities.size() && entities[parent].active )
+        {
+            ent.re.ApplyParentTransform( &entities[parent].re.worldMatrix, GetModel( ent.re.params.model ) );
+        }
+
+        const uint32_t entityMask = static_cast<uint32_t>( ent.re.params.renderMask );
+        if ( !entityMask || (entityMask & viewMask) )
+        {
+            visibleImmediates.push_back( &ent.re );
+        }
+    }
+
+    frame.entities.clear();
+    frame.entityCopies.clear();
+
+    // Static groups go first, DrawFrame keeps their packets as long as this list stays the same
+    std::vector<const RenderEntity*> visibleGroups;
+    frame.numStaticEntities = 0U;
+    for ( const StaticGroup& group : staticGroups )
+    {
+        const uint32_t groupMask = static_cast<uint32_t>( group.renderMask );
+        if ( !group.members.empty() && (!groupMask || (groupMask & viewMask)) )
+        {
+            visibleGroups.push_back( &group.proxy );
+            frame.numStaticEntities += group.members.size();
+        }
+    }
+    frame.numStaticGroups = visibleGroups.size();
+    frame.staticGroupsVersion = staticGroupsVersion;
+
+    // Drawing right away, nothing can change the entities in the meantime
+    if ( !renderThread.joinable() )
+    {
+        frame.entities.insert( frame.entities.end(), visibleGroups.begin(), visibleGroups.end() );
+        for ( const RenderEntityHandle& handle : visibleEntities )
+        {
+            frame.entities.push_back( &entities[handle].re );
+        }
+        frame.entities.insert( frame.entities.end(), visibleImmediates.begin(), visibleImmediates.end() );
+        return;
+    }
+
+    // The game will be updating the entities while the render thread draws them
+    // Static groups only need their proxies copied, the members are in the groups' batches
+    frame.entityCopies.reserve( visibleGroups.size() + visibleEntities.size() + visibleImmediates.size() );
+    for ( const RenderEntity* re : visibleGroups )
+    {
+        frame.entityCopies.push_back( *re );
+        frame.entities.push_back( &frame.entityCopies.back() );
+    }
+    for ( const RenderEntityHandle& handle : visibleEntities )
+    {
+        frame.entityCopies.push_back( entities[handle].re );
+        frame.entities.push_back( &frame.entityCopies.back() );
+    }
+    for ( const RenderEntity* re : visibleImmediates )
+    {
+        frame.entityCopies.push_back( *re );
+        frame.entities.push_back( &frame.entityCopies.back() );
+    }
+}
+
+// =====================================================================
+// RenderWorld::WaitForDrawnFrame
+// =====================================================================
+void RenderWorld::WaitForDrawnFrame()
+{
+    if ( !renderThread.joinable() )
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock( renderMutex );
+    renderCondition.wait( lock, [this]() { return numCommandsDone >= lastFrameTicket; } );
+}
+
+// =====================================================================
+// RenderWorld::DrawFrame
+// =====================================================================
+void RenderWorld::DrawFrame( const FrameSnapshot& frame )
+{
+    drawnFrame = &frame;
+    FrameStats stats = frame.stats;
+
+    backend->Clear();
+    backend->BeginFrame();
+
+    {
+        ScopedTimer timer( stats.cpuTimes[FramePass_Queue] );
+
+        // TODO: Subviews
+        backend->SetRenderView( &frame.view );
+        renderQueue.Clear();
+        const bool surfaceKeysChanged = UpdateSurfaceKeys();
+
+        // The packets of static groups only change along with the groups, so they're kept
+        // Their depth is from when they were queued, a group is spread out anyway
+        if ( surfaceKeysChanged || staticPacketsVersion != frame.staticGroupsVersion || staticPacketsMask != frame.view.renderMask )
+        {
+            staticPackets.clear();
+            for ( uint32_t i = 0U; i < frame.numStaticGroups; i++ )
+            {
+                QueueEntity( *frame.entities[i], i, frame.view, staticPackets );
+            }
+
+            staticPacketsVersion = frame.staticGroupsVersion;
+            staticPacketsMask = frame.view.renderMask;
+        }
+        renderQueue.Append( staticPackets );
+
+        // Generate the draw packets of everything else in parallel, each job into its own bucket
+        const uint32_t numDynamic = frame.entities.size() - frame.numStaticGroups;
+        renderQueue.PrepareBuckets( JobSystem::GetNumJobs( numDynamic, EntitiesPerJob ) );
+        jobs.ParallelFor( numDynamic, EntitiesPerJob, [&]( uint32_t first, uint32_t last, uint32_t jobIndex )
+        {
+            std::vector<DrawPacket>& bucket = renderQueue.GetBucket( jobIndex );
+            for ( uint32_t i = first + frame.numStaticGroups; i < last + frame.numStaticGroups; i++ )
+            {
+                QueueEntity( *frame.entities[i], i, frame.view, bucket );
+            }
+        } );
+        renderQueue.MergeBuckets();
+
+        stats.numEntities = numDynamic + frame.numStaticEntities;
+        stats.numSurfaces = renderQueue.GetPackets().size();
+    }
+
+    // Group the draws by state, then by depth, and render them
+    {
+        ScopedTimer timer( stats.cpuTimes[FramePass_Sort] );
+        renderQueue.Sort();
+    }
+
+    {
+        ScopedTimer timer( stats.cpuTimes[FramePass_Submit] );
+        SubmitRenderQueue();
+        backend->EndFrame();
+    }
+
+    drawnFrame = nullptr;
+    backend->GetFrameCounters( stats );
+
+    std::lock_guard<std::mutex> lock( statsMutex );
+    stats.frameNumber = numFramesDrawn;
+    frameStats[numFramesDrawn % FrameStats::HistorySize] = stats;
+    numFramesDrawn++;
+
+    // GPU times of earlier frames, if they're done by now and still in the history
+    uint64_t frameNumber = 0U;
+    float gpuTime = 0.0f;
+    while ( backend->GetGpuFrameTime( frameNumber, gpuTime ) )
+    {
+        FrameStats& gpuStats = frameStats[frameNumber % FrameStats::HistorySize];
+        if ( gpuStats.frameNumber == frameNumber )
+        {
+            gpuStats.gpuTime = gpuTime;
+        }
+    }
+}
+
+// =====================================================================
+// RenderWorld::GetFrameStats
+// =====================================================================
+FrameStats RenderWorld::GetFrameStats( const uint32_t& framesAgo ) const
+{
+    std::lock_guard<std::mutex> lock( statsMutex );
+    if ( framesAgo >= FrameStats::HistorySize || framesAgo >= numFramesDrawn )
+    {
+        return FrameStats();
+    }
+
+    return frameStats[(numFramesDrawn - 1U - framesAgo) % FrameStats::HistorySize];
+}
+
+// =====================================================================
+// RenderWorld::UpdateSurfaceKeys
+// =====================================================================
+bool RenderWorld::UpdateSurfaceKeys()
+{
+    // Overwritten in place, so it's cheap to tell whether anything changed
+    bool changed = firstSurfaceKeys.size() != models.size();
+    firstSurfaceKeys.resize( models.size() );
+
+    uint32_t numKeys = 0U;
+    for ( size_t i = 0U; i < models.size(); i++ )
+    {
+        changed |= firstSurfaceKeys[i] != numKeys;
+        firstSurfaceKeys[i] = numKeys;
+
+        for ( const auto& surface : models[i].mesh.surfaces )
+        {
+            const IMaterial* material = surface.material;
+            const SurfaceKey key{ renderQueue.GetShaderIndex( material->GetShader() ),
+                                  renderQueue.GetMaterialIndex( material ) };
+            if ( numKeys == surfaceKeys.size() )
+            {
+                surfaceKeys.push_back( key );
+                changed = true;
+            }
+            else if ( surfaceKeys[numKeys].shader != key.shader || surfaceKeys[numKeys].material != key.material )
+            {
+                surfaceKeys[numKeys] = key;
+                changed = true;
+            }
+
+            numKeys++;
+        }
+    }
+
+    if ( numKeys != surfaceKeys.size() )
+    {
+        surfaceKeys.resize( numKeys );
+        changed = true;
+    }
+
+    return changed;
+}
+
+// =====================================================================
+// RenderWorld::QueueEntity
+// =====================================================================
+void RenderWorld::QueueEntity( const RenderEntity& re, const uint32_t& index, const RenderView& view, std::vector<DrawPacket>& bucket ) const
+{
+    int numSurfaces = GetNumSurfacesForModel( re.params.model );
+    if ( numSurfaces == RenderHandleInvalid )
+    {
+        return;
+    }
+
+    // Invalid batches render as single instances
+    DrawPacket packet;
+    packet.entity = index;
+    packet.batch = re.params.batch;
+    packet.batchSize = 0;
+    uint16_t shaderFlags = ShaderFlag_Normal;
+    if ( backend->IsBatchValid( packet.batch ) )
+    {
+        packet.batchSize = backend->GetBatchSize( packet.batch );
+        shaderFlags |= ShaderFlag_Instanced;
+        if ( backend->GetBatchFormat( packet.batch ) == BatchFormat_Compact )
+        {
+            shaderFlags |= ShaderFlag_CompactInstanced;
+        }
+    }
+    else
+    {
+        packet.batch = BatchInvalid;
+    }
+
+    const float depth = glm::length( (re.worldMins + re.worldMaxs) * 0.5f - view.cameraPosition );
+    const SurfaceKey* keys = &surfaceKeys[firstSurfaceKeys[re.params.model]];
+
+    // All surfaces go through the rendering
+    // TODO: Material properties to not render under certain circumstances
+    for ( int i = 0; i < numSurfaces; i++ )
+    {
+        packet.surface = i;
+        packet.key = DrawKey::Make( RenderPass_Opaque, keys[i].shader, shaderFlags, keys[i].material,
+                                    re.params.model, i, depth );
+
+        bucket.push_back( packet );
+    }
+}
+
+// =====================================================================
+// RenderWorld::SubmitRenderQueue
+// =====================================================================
+void RenderWorld::SubmitRenderQueue()
+{
+    const std::vector<DrawPacket>& packets = renderQueue.GetPackets();
+
+    indirectList.Clear();
+
+    size_t i = 0U;
+    uint64_t currentPass = ~0ULL;
+    while ( i < packets.size() )
+    {
+        const DrawPacket& packet = packets[i];
+        const RenderEntity& re = GetPacketEntity( packet );
+
+        // Everything of the previous pass has to be drawn first
+        const uint64_t pass = packet.key >> DrawKey::PassShift;
+        if ( pass != currentPass )
+        {
+            FlushIndirectCommands();
+            currentPass = pass;
+        }
+
+        // Batches already come in one draw call
+        if ( packet.batch != BatchInvalid )
+        {
+            FlushIndirectCommands();
+            backend->RenderSurfaceBatch( re.params.model, re.worldMatrix, packet.surface, packet.batch, packet.batchSize );
+            i++;
+            continue;
+        }
+
+        // The queue is sorted, so entities with the same surface and state
+        // are right next to each other
+        size_t runEnd = i + 1U;
+        while ( runEnd < packets.size() && CanInstanceTogether( packet, packets[runEnd] ) )
+        {
+            runEnd++;
+        }
+
+        // The whole run becomes one indirect command, drawn together with the
+        // runs that follow it, up until something has to be drawn directly
+        const IShader* shader = models[re.params.model].mesh.surfaces[packet.surface].material->GetShader();
+        if ( useIndirectDrawing && shader->SupportsFlags( ShaderFlag_Normal | ShaderFlag_Indirect ) )
+        {
+            AddIndirectCommand( packets, i, runEnd );
+            i = runEnd;
+            continue;
+        }
+
+        // Keep the sort order, indirect commands before this run are drawn before it
+        FlushIndirectCommands();
+
+        // Not enough of them, draw them one by one
+        const size_t runLength = runEnd - i;
+        if ( !autoInstancingThreshold || runLength < autoInstancingThreshold || runLength <= BatchSizeThreshold )
+        {
+            for ( ; i < runEnd; i++ )
+            {
+                const RenderEntity& single = GetPacketEntity( packets[i] );
+                backend->RenderSurfaceBatch( single.params.model, single.worldMatrix, packets[i].surface, BatchInvalid, 0 );
+            }
+            continue;
+        }
+
+        // Write the model matrices of the whole run straight into GPU memory and draw them in one go
+        uint32_t firstInstance = 0U;
+        RenderBatchParam* instances = backend->AllocateTransientInstances( runLength, firstInstance );
+        if ( nullptr == instances )
+        {
+            for ( ; i < runEnd; i++ )
+            {
+                const RenderEntity& single = GetPacketEntity( packets[i] );
+                backend->RenderSurfaceBatch( single.params.model, single.worldMatrix, packets[i].surface, BatchInvalid, 0 );
+            }
+            continue;
+        }
+
+        for ( size_t p = i; p < runEnd; p++ )
+        {
+            instances[p - i].modelMatrix = GetPacketEntity( packets[p] ).worldMatrix;
+        }
+
+        backend->RenderSurfaceInstances( re.params.model, packet.surface, firstInstance, runLength );
+        i = runEnd;
+    }
+
+    FlushIndirectCommands();
+}
+
+// =====================================================================
+// RenderWorld::FlushIndirectCommands
+// =====================================================================
+void RenderWorld::FlushIndirectCommands()
+{
+    if ( indirectList.commands.empty() )
+    {
+        return;
+    }
+
+    backend->RenderIndirect( indirectList );
+    indirectList.Clear();
+}
+
+// =====================================================================
+// RenderWorld::AddIndirectCommand
+// =====================================================================
+void RenderWorld::AddIndirectCommand( const std::vector<DrawPacket>& packets, const size_t& first, const size_t& last )
+{
+    const DrawPacket& packet = packets[first];
+    const RenderModelHandle& model = GetPacketEntity( packet ).params.model;
+    const SurfaceGeometry geometry = backend->GetSurfaceGeometry( model, packet.surface );
+    if ( !geometry.numIndices )
+    {
+        return;
+    }
+
+    // Shader, shader flags and material have to match within a bucket,
+    // and so does the vertex array, as it's bound once per multi-draw
+    // The shader and material indices in the key wrap around once there are
+    // enough of them, so the material, which decides the shader, is compared too
+    const uint64_t stateKey = packet.key >> DrawKey::MaterialShift;
+    const IMaterial* material = models[model].mesh.surfaces[packet.surface].material;
+    if ( indirectList.buckets.empty()
+         || indirectList.buckets.back().stateKey != stateKey
+         || indirectList.buckets.back().material != material
+         || indirectList.buckets.back().vertexArray != geometry.vertexArray )
+    {
+        DrawIndirectBucket bucket;
+        bucket.model = model;
+        bucket.surface = packet.surface;
+        bucket.firstCommand = indirectList.commands.size();
+        bucket.numCommands = 0U;
+        bucket.stateKey = stateKey;
+        bucket.material = material;
+        bucket.vertexArray = geometry.vertexArray;
+        indirectList.buckets.push_back( bucket );
+    }
+
+    // The shader finds its DrawData through gl_BaseInstance + gl_InstanceID
+    DrawElementsIndirectCommand command;
+    command.count = geometry.numIndices;
+    command.instanceCount = last - first;
+    command.firstIndex = geometry.firstIndex;
+    command.baseVertex = geometry.baseVertex;
+    command.baseInstance = indirectList.drawData.size();
+    indirectList.commands.push_back( command );
+    indirectList.buckets.back().numCommands++;
+
+    // Not the one in the key, that one may have wrapped around
+    const uint32_t materialIndex = surfaceKeys[firstSurfaceKeys[model] + packet.surface].material;
+    for ( size_t p = first; p < last; p++ )
+    {
+        DrawData data;
+        data.modelMatrix = GetPacketEntity( packets[p] ).worldMatrix;
+        data.materialIndex = materialIndex;
+        indirectList.drawData.push_back( data );
+    }
+}
+
+// =====================================================================
+// RenderWorld::CanInstanceTogether
+// =====================================================================
+bool RenderWorld::CanInstanceTogether( const DrawPacket& a, const DrawPacket& b ) const
+{
+    if ( b.batch != BatchInvalid || a.surface != b.surface )
+    {
+        return false;
+    }
+
+    // Everything but the depth has to match
+    if ( (a.key >> DrawKey::VertexArrayShift) != (b.key >> DrawKey::VertexArrayShift) )
+    {
+        return false;
+    }
+
+    // Model handles are truncated in the key, so compare them directly too
+    // The same surface of the same model also has the same material and shader,
+    // even if their indices in the key have wrapped around
+    return GetPacketEntity( a ).params.model == GetPacketEntity( b ).params.model;
+}
+
+// =====================================================================
+// RenderWorld::LinkEntity
+// =====================================================================
+void RenderWorld::LinkEntity( const RenderEntityHandle& handle )
+{
+    entities[handle].linkedMask = entities[handle].re.params.renderMask;
+    const uint32_t entityMask = static_cast<uint32_t>( entities[handle].linkedMask );
+    if ( !entityMask )
+    {
+        unmaskedEntities.push_back( handle );
+        return;
+    }
+
+    for ( uint32_t bit = 0U; bit < RenderMaskBits; bit++ )
+    {
+        if ( entityMask & (1U << bit) )
+        {
+            maskedEntities[bit].push_back( handle );
+        }
+    }
+}
+
+// =====================================================================
+// RenderWorld::UnlinkEntity
+// =====================================================================
+void RenderWorld::UnlinkEntity( const RenderEntityHandle& handle )
+{
+    // Order doesn't matter in these lists, so swap with the last one and pop
+    auto removeFromList = [&handle]( EntityList& list )
+    {
+        auto iter = std::find( list.begin(), list.end(), handle );
+        if ( iter != list.end() )
+        {
+            *iter = list.back();
+            list.pop_back();
+        }
+    };
+
+    // The params may already have a new render mask, see UpdateEntity
+    const uint32_t entityMask = static_cast<uint32_t>( entities[handle].linkedMask );
+    if ( !entityMask )
+    {
+        removeFromList( unmaskedEntities );
+        return;
+    }
+
+    for ( uint32_t bit = 0U; bit < RenderMaskBits; bit++ )
+    {
+        if ( entityMask & (1U << bit) )
+        {
+            removeFromList( maskedEntities[bit] );
+        }
+    }
+}
+
+// =====================================================================
+// RenderWorld::QueueUpdate
+// =====================================================================
+void RenderWorld::QueueUpdate( const RenderEntityHandle& handle )
+{
+    // Each entity goes in once, so there's always room for it
+    if ( !entities[handle].updateQueued.exchange( true, std::memory_order_relaxed ) )
+    {
+        pendingUpdates[numPendingUpdates.fetch_add( 1U, std::memory_order_relaxed )] = handle;
+    }
+}
+
+// =====================================================================
+// RenderWorld::ApplyPendingUpdates
+// =====================================================================
+void RenderWorld::ApplyPendingUpdates()
+{
+    dirtyTransforms.clear();
+
+    const uint32_t numUpdates = numPendingUpdates.exchange( 0U, std::memory_order_relaxed );
+    for ( uint32_t i = 0U; i < numUpdates; i++ )
+    {
+        const RenderEntityHandle& handle = pendingUpdates[i];
+        RenderEntitySlot& slot = entities[handle];
+        slot.updateQueued.store( false, std::memory_order_relaxed );
+
+        // Destroyed in the meantime, which already took care of the lists
+        if ( !slot.active )
+        {
+            continue;
+        }
+
+        // Static entities move between groups, or between a group and the entity lists
+        const bool groupable = CanBeGrouped( slot.re.params );
+        if ( slot.staticGroup != NoStaticGroup )
+        {
+            const StaticGroup& group = staticGroups[slot.staticGroup];
+            if ( !groupable || group.model != slot.re.params.model || group.renderMask != slot.re.params.renderMask )
+            {
+                LeaveStaticGroup( handle );
+                if ( groupable )
+                {
+                    JoinStaticGroup( handle );
+                }
+                else
+                {
+                    LinkEntity( handle );
+                }
+            }
+        }
+        else if ( groupable )
+        {
+            UnlinkEntity( handle );
+            JoinStaticGroup( handle );
+        }
+        else if ( slot.linkedMask != slot.re.params.renderMask )
+        {
+            UnlinkEntity( handle );
+            LinkEntity( handle );
+        }
+
+        if ( slot.linkedParent != slot.re.params.parent )
+        {
+            SetParent( handle, slot.re.params.parent );
+            slot.transformDirty = true;
+        }
+
+        if ( slot.transformDirty )
+        {
+            dirtyTransforms.push_back( handle );
+        }
+    }
+
+    UpdateHierarchy();
+}
+
+// =====================================================================
+// RenderWorld::SetParent
+// =====================================================================
+void RenderWorld::SetParent( const RenderEntityHandle& handle, RenderEntityHandle parent )
+{
+    RenderEntitySlot& slot = entities[handle];
+
+    // Inactive parents and parents that are children of this entity are ignored
+    if ( parent != RenderHandleInvalid )
+    {
+        if ( parent >= entities.size() || !entities[parent].active )
+        {
+            parent = RenderHandleInvalid;
+        }
+
+        for ( RenderEntityHandle ancestor = parent; ancestor != RenderHandleInvalid; ancestor = entities[ancestor].linkedParent )
+        {
+            if ( ancestor == handle )
+            {
+                parent = RenderHandleInvalid;
+                break;
+            }
+        }
+    }
+
+    if ( slot.linkedParent != RenderHandleInvalid )
+    {
+        EntityList& siblings = entities[slot.linkedParent].children;
+        auto iter = std::find( siblings.begin(), siblings.end(), handle );
+        if ( iter != siblings.end() )
+        {
+            *iter = siblings.back();
+            siblings.pop_back();
+        }
+    }
+
+    slot.linkedParent = parent;
+    if ( parent != RenderHandleInvalid )
+    {
+        entities[parent].children.push_back( handle );
+    }
+}
+
+// =====================================================================
+// RenderWorld::UpdateHierarchy
+// =====================================================================
+void RenderWorld::UpdateHierarchy()
+{
+    // Entities under a dirty ancestor get recalculated along with it,
+    // so only start from the topmost dirty ones
+    hierarchyQueue.clear();
+    for ( const RenderEntityHandle& handle : dirtyTransforms )
+    {
+        bool underDirtyAncestor = false;
+        for ( RenderEntityHandle ancestor = entities[handle].linkedParent; ancestor != RenderHandleInvalid; ancestor = entities[ancestor].linkedParent )
+        {
+            if ( entities[ancestor].transformDirty )
+            {
+                underDirtyAncestor = true;
+                break;
+            }
+        }
+
+        if ( !underDirtyAncestor )
+        {
+            hierarchyQueue.push_back( handle );
+        }
+    }
+
+    // Breadth-first, so parents are always done before their children,
+    // and the queue only ever holds the subtrees that actually moved
+    for ( size_t i = 0U; i < hierarchyQueue.size(); i++ )
+    {
+        const RenderEntityHandle handle = hierarchyQueue[i];
+        RenderEntitySlot& slot = entities[handle];
+
+        const glm::mat4* parentMatrix = (slot.linkedParent != RenderHandleInvalid) ? &entities[slot.linkedParent].re.worldMatrix : nullptr;
+        slot.re.ApplyParentTransform( parentMatrix, GetModel( slot.re.params.model ) );
+
+        hierarchyQueue.insert( hierarchyQueue.end(), slot.children.begin(), slot.children.end() );
+    }
+
+    for ( const RenderEntityHandle& handle : dirtyTransforms )
+    {
+        entities[handle].transformDirty = false;
+    }
+
+    // Every entity that moved is in the queue by now, grouped ones only upload their own instance
+    for ( const RenderEntityHandle& handle : hierarchyQueue )
+    {
+        if ( entities[handle].staticGroup != NoStaticGroup )
+        {
+            UploadStaticInstance( handle );
+        }
+    }
+}
+
+// =====================================================================
+// RenderWorld::CanBeGrouped
+// =====================================================================
+bool RenderWorld::CanBeGrouped( const RenderEntityParams& params ) const
+{
+    // Entities with their own batch are drawn with it, like any other entity
+    return params.isStatic && params.batch == BatchInvalid && nullptr != GetModel( params.model );
+}
+
+// =====================================================================
+// RenderWorld::JoinStaticGroup
+// =====================================================================
+void RenderWorld::JoinStaticGroup( const RenderEntityHandle& handle )
+{
+    RenderEntitySlot& slot = entities[handle];
+    const RenderEntityParams& params = slot.re.params;
+
+    const uint64_t key = (uint64_t( params.model ) << 32U) | static_cast<uint32_t>( params.renderMask );
+    auto iter = staticGroupIndices.find( key );
+    if ( iter == staticGroupIndices.end() )
+    {
+        StaticGroup group;
+        group.model = params.model;
+        group.renderMask = params.renderMask;
+        iter = staticGroupIndices.emplace( key, staticGroups.size() ).first;
+        staticGroups.push_back( std::move( group ) );
+    }
+
+    StaticGroup& group = staticGroups[iter->second];
+    slot.staticGroup = iter->second;
+    slot.staticInstance = group.members.size();
+    slot.linkedMask = group.renderMask;
+    group.members.push_back( handle );
+    MarkStaticGroupDirty( iter->second );
+}
+
+// =====================================================================
+// RenderWorld::LeaveStaticGroup
+// =====================================================================
+void RenderWorld::LeaveStaticGroup( const RenderEntityHandle& handle )
+{
+    RenderEntitySlot& slot = entities[handle];
+    StaticGroup& group = staticGroups[slot.staticGroup];
+
+    // Swap with the last one and pop, the batch gets rebuilt anyway
+    const RenderEntityHandle last = group.members.back();
+    group.members[slot.staticInstance] = last;
+    entities[last].staticInstance = slot.staticInstance;
+    group.members.pop_back();
+
+    MarkStaticGroupDirty( slot.staticGroup );
+    slot.staticGroup = NoStaticGroup;
+}
+
+// =====================================================================
+// RenderWorld::MarkStaticGroupDirty
+// =====================================================================
+void RenderWorld::MarkStaticGroupDirty( const uint32_t& index )
+{
+    if ( !staticGroups[index].dirty )
+    {
+        staticGroups[index].dirty = true;
+        dirtyStaticGroups.push_back( index );
+    }
+}
+
+// =====================================================================
+// RenderWorld::UploadStaticInstance
+// =====================================================================
+void RenderWorld::UploadStaticInstance( const RenderEntityHandle& handle )
+{
+    const RenderEntitySlot& slot = entities[handle];
+    StaticGroup& group = staticGroups[slot.staticGroup];
+
+    // The whole batch is about to be rebuilt
+    if ( group.dirty )
+    {
+        return;
+    }
+
+    if ( group.batch == BatchInvalid )
+    {
+        group.proxy.worldMatrix = slot.re.worldMatrix;
+        group.proxy.worldMins = slot.re.worldMins;
+        group.proxy.worldMaxs = slot.re.worldMaxs;
+        return;
+    }
+
+    const RenderBatchParam instance{ slot.re.worldMatrix };
+    UpdateBatch( group.batch, &instance, slot.staticInstance, 1U );
+}
+
+// =====================================================================
+// RenderWorld::UpdateStaticGroups
+// =====================================================================
+void RenderWorld::UpdateStaticGroups()
+{
+    if ( dirtyStaticGroups.empty() )
+    {
+        return;
+    }
+
+    for ( size_t i = 0U; i < dirtyStaticGroups.size(); i++ )
+    {
+        const uint32_t index = dirtyStaticGroups[i];
+        StaticGroup& group = staticGroups[index];
+        group.dirty = false;
+
+        if ( group.batch != BatchInvalid )
+        {
+            DestroyBatch( group.batch );
+            group.batch = BatchInvalid;
+        }
+
+        if ( group.members.empty() )
+        {
+            continue;
+        }
+
+        // One member is drawn like a regular entity, more than that from the batch
+        const RenderEntity& first = entities[group.members.front()].re;
+        group.proxy = first;
+        group.proxy.params.parent = RenderHandleInvalid;
+        if ( group.members.size() == 1U )
+        {
+            continue;
+        }
+
+        staticInstances.clear();
+        for ( const RenderEntityHandle& member : group.members )
+        {
+            const RenderEntity& re = entities[member].re;
+            staticInstances.push_back( { re.worldMatrix } );
+            group.proxy.worldMins = glm::min( group.proxy.worldMins, re.worldMins );
+            group.proxy.worldMaxs = glm::max( group.proxy.worldMaxs, re.worldMaxs );
+        }
+
+        group.batch = CreateBatch( staticInstances.data(), staticInstances.size() );
+        if ( group.batch == BatchInvalid )
+        {
+            // Better slow than invisible, the members go back to being drawn one by one
+            printf( "RenderWorld::UpdateStaticGroups: cannot create a batch for %u static entities, drawing them separately\n",
+                    static_cast<uint32_t>( group.members.size() ) );
+            for ( const RenderEntityHandle& member : group.members )
+            {
+                entities[member].staticGroup = NoStaticGroup;
+                LinkEntity( member );
+            }
+            group.members.clear();
+            continue;
+        }
+
+        // The instances carry the world matrices
+        group.proxy.params.batch = group.batch;
+        group.proxy.worldMatrix = glm::identity<glm::mat4>();
+    }
+
+    dirtyStaticGroups.clear();
+    staticGroupsVersion++;
+}
+
+// =====================================================================
+// RenderWorld::ClearImmediateEntities
+// =====================================================================
+void RenderWorld::ClearImmediateEntities()
+{
+    const uint32_t numImmediate = std::min( numImmediateEntities.load( std::memory_order_relaxed ), MaxImmediateEntities );
+    for ( uint32_t i = 0U; i < numImmediate; i++ )
+    {
+        immediateEntities[i].published.store( false, std::memory_order_relaxed );
+    }
+
+    numImmediateEntities.store( 0U, std::memory_order_relaxed );
+}
+
+// =====================================================================
+// RenderWorld::GetModel
+// =====================================================================
+const Model* RenderWorld::GetModel( const RenderModelHandle& handle ) const
+{
+    if ( handle == RenderHandleInvalid || handle >= models.size() )
+    {
+        return nullptr;
+    }
+
+    return &models[handle];
+}
+
+// =====================================================================
+// RenderWorld::GetNumSurfacesForModel
+// =====================================================================
+uint32_t RenderWorld::GetNumSurfacesForModel( const RenderModelHandle& handle ) const
+{
+    if ( handle == RenderHandleInvalid || handle >= models.size() )
+    {
+        return RenderHandleInvalid;
+    }
+
+    return models.at( handle ).mesh.surfaces.size();
 }
 
 // =====================================================================
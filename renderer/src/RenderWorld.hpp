@@ -4,8 +4,20 @@ class IRenderWorld;
 class IRenderer;
 
 #include "RenderEntity.hpp"
+#include "RenderQueue.hpp"
+#include "IRenderer.hpp"
+#include "JobSystem.hpp"
+#include "FileWatcher.hpp"
 #include <array>
+#include <atomic>
 #include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <unordered_map>
 
 class RenderWorld : public IRenderWorld
@@ -28,19 +40,28 @@ public:
     // @returns true on success, false if the handle is invalid, or the params are invalid
     bool                    UpdateEntity( const RenderEntityHandle& handle, const RenderEntityParams& params ) override;
     // Submits the entity to the renderworld immediately, to be drawn this frame
-    // @returns true on success, false if the params are invalid
+    // @returns true on success, false if the params are invalid or there are too many this frame
     bool                    CreateImmediateEntity( const RenderEntityParams& params ) override;
     // Frees the render entity from the renderworld, no longer to be rendered again
     // If you wish to just hide entities, update render entity params instead
     void                    DestroyEntity( const RenderEntityHandle& handle ) override;
 
+    // Copies the batch data into the renderer, the params can be freed right after
+    BatchHandle             CreateBatch( const RenderBatchParam* params, const uint32_t& batchSize ) override;
+    BatchHandle             CreateBatch( const RenderBatchCompactParam* params, const uint32_t& batchSize ) override;
+    // Overwrites instances [first, first + count) of the batch, only that part gets uploaded
+    bool                    UpdateBatch( const BatchHandle& handle, const RenderBatchParam* params, const uint32_t& first, const uint32_t& count ) override;
+    bool                    UpdateBatch( const BatchHandle& handle, const RenderBatchCompactParam* params, const uint32_t& first, const uint32_t& count ) override;
+    // Frees the batch, render entities still using it are drawn as single instances
+    void                    DestroyBatch( const BatchHandle& handle ) override;
+
     // ========================================
     // Render model manipulation
 
     // Creates a model from given parameters
     RenderModelHandle       CreateModel( const RenderModelParams& params ) override;
     // Updates a model dynamically, only for dynamic models
-    void                    UpdateModel( const RenderModelHandle& handle, const RenderModelParams& params ) override;
+    bool                    UpdateModel( const RenderModelHandle& handle, const RenderModelParams& params ) override;
 
     // ========================================
     // Material, texture and shader business
@@ -73,6 +94,12 @@ public:
     // Renders the view into a frame
     void                    RenderFrame( const RenderView& view ) override;
 
+    // ========================================
+    // Statistics
+
+    // @returns Timings and counters of a frame that was drawn, 0 being the last one
+    FrameStats              GetFrameStats( const uint32_t& framesAgo ) const override;
+
     // ========================================
     // Utilities
 
@@ -83,27 +110,277 @@ public:
 private:
     // @param handle: a valid handle to a model
     // @returns the number of surfaces a model has
-    uint32_t                GetNumSurfacesForModel( const RenderModelHandle& handle );
-    // Utility for obtaining the batchID from the render backend
-    // @returns: BatchInvalid if there's no batch data; a valid batchID otherwise
-    BatchHandle             GetBatchIndex( const RenderEntityParams& params );
+    uint32_t                GetNumSurfacesForModel( const RenderModelHandle& handle ) const;
+    // @returns The model, or nullptr if the handle is invalid
+    const Model*            GetModel( const RenderModelHandle& handle ) const;
+
+    // Adds the entity to the entity list of every render mask bit it has,
+    // or to the unmasked list if its render mask is 0
+    void                    LinkEntity( const RenderEntityHandle& handle );
+    // Removes the entity from all the entity lists it's in
+    void                    UnlinkEntity( const RenderEntityHandle& handle );
+    // Adds the entity to pendingUpdates, unless it's already in there
+    // Can be called from several threads at once
+    void                    QueueUpdate( const RenderEntityHandle& handle );
+    // Moves the entities whose render mask or parent was changed by UpdateEntity to their new lists,
+    // and recalculates the world matrices of moved hierarchies
+    // UpdateEntity can run on several threads, so it only queues them for this
+    void                    ApplyPendingUpdates();
+    // Detaches the entity from its current parent and attaches it to the new one,
+    // which stays invalid if it's inactive or would make a loop
+    void                    SetParent( const RenderEntityHandle& handle, RenderEntityHandle parent );
+    // Recalculates the world matrices of the dirty entities and everything under them
+    void                    UpdateHierarchy();
+    // Frees the immediate entities of the frame that was just submitted
+    void                    ClearImmediateEntities();
+
+    // @returns true if the entity can be drawn from a static group, see StaticGroup
+    bool                    CanBeGrouped( const RenderEntityParams& params ) const;
+    // Adds the entity to the static group of its model and render mask, creating one if needed
+    void                    JoinStaticGroup( const RenderEntityHandle& handle );
+    // Removes the entity from its static group, the group gets rebuilt before the next frame
+    void                    LeaveStaticGroup( const RenderEntityHandle& handle );
+    void                    MarkStaticGroupDirty( const uint32_t& index );
+    // Sends the world matrix of a grouped entity to its group, only its own instance gets uploaded
+    void                    UploadStaticInstance( const RenderEntityHandle& handle );
+    // Rebuilds the batches and proxies of the static groups that gained or lost entities
+    void                    UpdateStaticGroups();
+
+    struct                  ResourceReload;
+    // Starts watching every file the shader is made of, if hot reloading is on
+    void                    WatchShader( IShader* shader );
+    // Starts reloading the textures and models whose files changed, and hands the
+    // changed files and the finished reloads over to ApplyHotReload
+    void                    UpdateHotReload();
+    // Reloads the shaders made of any of the changed files, and swaps in the finished
+    // textures and models. Needs the context
+    void                    ApplyHotReload( const std::vector<std::string>& changedFiles,
+                                            const std::vector<std::shared_ptr<ResourceReload>>& finishedReloads );
+    // Everything the render thread needs to draw one frame
+    struct                  FrameSnapshot
+    {
+        RenderView          view;
+        // Copies of the visible render entities, if there is a render thread
+        std::vector<RenderEntity> entityCopies;
+        // Either the render entities themselves or their copies, DrawPacket::entity indexes this
+        // The visible static groups come first, in the same order as long as the groups don't change
+        std::vector<const RenderEntity*> entities;
+        uint32_t            numStaticGroups{ 0U };
+        // Number of static entities drawn by those groups, for the stats
+        uint32_t            numStaticEntities{ 0U };
+        // See staticGroupsVersion
+        uint64_t            staticGroupsVersion{ 0U };
+        // Timings of the passes that ran before the frame was handed over
+        FrameStats          stats;
+    };
+
+    // Puts the view and the entities it can see into the frame
+    void                    TakeSnapshot( const RenderView& view, FrameSnapshot& frame );
+    // Builds the render queue of the frame and draws it
+    void                    DrawFrame( const FrameSnapshot& frame );
+    // @returns The entity this packet was queued from, in the frame being drawn
+    const RenderEntity&     GetPacketEntity( const DrawPacket& packet ) const
+    {
+        return *drawnFrame->entities[packet.entity];
+    }
+
+    // @returns true if there's a render thread and this isn't it,
+    // i.e. calls that use the backend have to go through RunOnRenderThread
+    bool                    NeedsRenderThread() const;
+    // Runs the command on the render thread, after everything that's queued before it
+    // @param wait: return only once the command is done
+    // @returns The command's ticket, it's done once numCommandsDone reaches it
+    uint64_t                RunOnRenderThread( std::function<void()> command, const bool& wait );
+    void                    RenderThreadLoop();
+    void                    StopRenderThread();
+    // Blocks until the render thread is done with the last frame it was given,
+    // so the snapshot it was drawing can be written again
+    void                    WaitForDrawnFrame();
+
+    // Looks up the shader and material indices of every model surface, so
+    // the render queue's index maps aren't touched by parallel jobs
+    // @returns true if any of them changed since the last frame
+    bool                    UpdateSurfaceKeys();
+    // Adds all surfaces of a render entity to a bucket of the render queue
+    // Can run on any thread, as long as every thread has its own bucket
+    // @param index: the entity's index in the frame snapshot
+    void                    QueueEntity( const RenderEntity& re, const uint32_t& index, const RenderView& view, std::vector<DrawPacket>& bucket ) const;
+    // Checks the params and passes them onto the backend, for both types of batch params
+    BatchHandle             CreateBatch( const void* params, const uint32_t& batchSize, const BatchFormat& format );
+    bool                    UpdateBatch( const BatchHandle& handle, const void* params, const uint32_t& first, const uint32_t& count, const BatchFormat& format );
+    // Sends the sorted render queue to the backend
+    void                    SubmitRenderQueue();
+    // @returns true if both packets draw the same model surface with the same state,
+    // so they can go into one automatically instanced draw
+    bool                    CanInstanceTogether( const DrawPacket& a, const DrawPacket& b ) const;
+    // Adds one indirect command for packets [first, last), which can all be instanced together
+    void                    AddIndirectCommand( const std::vector<DrawPacket>& packets, const size_t& first, const size_t& last );
+    // Draws the indirect commands collected so far, so that whatever is drawn next comes after them
+    void                    FlushIndirectCommands();
 private:
-    using                   BatchMap = std::unordered_map<const RenderEntityParams*, BatchHandle>;
+    using                   EntityList = std::vector<RenderEntityHandle>;
+    static constexpr uint32_t NoStaticGroup = ~0U;
     struct                  RenderEntitySlot
     {
         RenderEntity    re;
         bool            active{ false };
-        bool            temporary{ false };
+        // The render mask the entity lists currently have this entity under
+        int             linkedMask{ 0 };
+        // Set once the entity is in pendingUpdates, so it only goes in once
+        std::atomic<bool> updateQueued{ false };
+
+        // The parent the hierarchy currently has this entity under
+        RenderEntityHandle linkedParent{ RenderHandleInvalid };
+        EntityList      children;
+        // The local transform changed, so the world matrices of this and all children are stale
+        bool            transformDirty{ false };
+
+        // The static group that draws this entity, it's in none of the entity lists then
+        uint32_t        staticGroup{ NoStaticGroup };
+        // This entity's instance in the group's batch
+        uint32_t        staticInstance{ 0U };
+    };
+
+    // Static entities of the same model and render mask, drawn as one entity. Their world matrices
+    // live in a batch owned by the renderer, so they stay on the GPU until one of them moves, and
+    // the draw packets of all groups are kept between frames, see DrawFrame
+    struct                  StaticGroup
+    {
+        RenderModelHandle model;
+        int             renderMask;
+        EntityList      members;
+        // Holds the members' world matrices, in the order of members
+        // Invalid if there's only one member, the proxy has its world matrix then
+        BatchHandle     batch{ BatchInvalid };
+        // What gets drawn in place of the members
+        RenderEntity    proxy;
+        // Members were added or removed, UpdateStaticGroups rebuilds the batch
+        bool            dirty{ false };
     };
 
+    // Entities from CreateImmediateEntity are written by whichever thread claimed them,
+    // and only seen by TakeSnapshot once published
+    struct                  ImmediateEntity
+    {
+        RenderEntity    re;
+        std::atomic<bool> published{ false };
+    };
+
+    static constexpr uint32_t MaxEntities = 16384U;
+    static constexpr uint32_t MaxImmediateEntities = 8192U;
+
     IRenderer*              backend{ nullptr };
-    std::array<RenderEntitySlot, 16384U> entities;
+    std::array<RenderEntitySlot, MaxEntities> entities;
+    std::array<ImmediateEntity, MaxImmediateEntities> immediateEntities;
+    // Number of claimed immediate entities, may go past MaxImmediateEntities
+    std::atomic<uint32_t>   numImmediateEntities{ 0U };
+    // Handles of entities that changed their render mask, parent, or moved with children
+    // or a parent since the last frame
+    std::array<RenderEntityHandle, MaxEntities> pendingUpdates;
+    std::atomic<uint32_t>   numPendingUpdates{ 0U };
+    // Scratch lists of UpdateHierarchy
+    EntityList              dirtyTransforms;
+    EntityList              hierarchyQueue;
+
+    // Render mask 0 -> rendered in every view
+    EntityList              unmaskedEntities;
+    // One list per render mask bit, so views with a narrow render mask
+    // only go through the entities they can actually see
+    std::array<EntityList, RenderMaskBits> maskedEntities;
+    // Entities on the view's render layers, queued in parallel
+    EntityList              visibleEntities;
+
+    std::vector<StaticGroup> staticGroups;
+    // Model handle in the upper 32 bits, render mask in the lower ones
+    std::unordered_map<uint64_t, uint32_t> staticGroupIndices;
+    std::vector<uint32_t>   dirtyStaticGroups;
+    // Goes up whenever a static group is rebuilt, so the render thread knows its cached packets are stale
+    uint64_t                staticGroupsVersion{ 0U };
+    // Scratch list of UpdateStaticGroups
+    std::vector<RenderBatchParam> staticInstances;
+
+    // Draw packets of the visible static groups, only touched by whoever draws the frames
+    // Queued again only when the groups, the view's render mask, or the surface keys change
+    std::vector<DrawPacket> staticPackets;
+    uint64_t                staticPacketsVersion{ ~0ULL };
+    int                     staticPacketsMask{ 0 };
 
     std::vector<Model>      models;
     std::vector<IShader*>   shaders;
     std::vector<ITexture*>  textures;
     std::vector<IMaterial*> materials;
-    BatchMap                batches;
+    RenderQueue             renderQueue;
+    JobSystem               jobs;
+
+    // Parts of the draw key that only depend on the model surface
+    struct                  SurfaceKey
+    {
+        uint32_t        shader;
+        uint32_t        material;
+    };
+
+    // A texture or a model that's being read again on another thread
+    struct                  ResourceReload
+    {
+        // Only one of these is set
+        ITexture*           texture{ nullptr };
+        RenderModelHandle   model{ RenderHandleInvalid };
+        // Normalised path of the file that changed
+        std::string         path;
+
+        // The decoded texture, nullptr if it couldn't be read
+        byte*               imageData{ nullptr };
+        int                 width{ 0 };
+        int                 height{ 0 };
+        Model               loadedModel;
+
+        std::future<void>   loaded;
+    };
+
+    // See RenderInitParams::hotReload
+    FileWatcher             fileWatcher;
+    std::vector<std::shared_ptr<ResourceReload>> resourceReloads;
+    // Files that changed again while their texture or model was still being reloaded
+    std::vector<std::string> deferredChanges;
+
+    // Indexed by firstSurfaceKeys[model] + surface
+    std::vector<SurfaceKey> surfaceKeys;
+    std::vector<uint32_t>   firstSurfaceKeys;
+
+    // Stats of the last FrameStats::HistorySize frames, indexed by frame number
+    std::array<FrameStats, FrameStats::HistorySize> frameStats;
+    uint64_t                numFramesDrawn{ 0U };
+    // The render thread writes the stats, the game reads them
+    mutable std::mutex      statsMutex;
+
+    // Fewer than this many entities per job and the overhead isn't worth it
+    static constexpr uint32_t EntitiesPerJob = 512U;
+
+    // See RenderInitParams::autoInstancingThreshold
+    uint32_t                autoInstancingThreshold{ 0U };
+    // See RenderInitParams::useIndirectDrawing
+    bool                    useIndirectDrawing{ false };
+    // Indirect commands of the current frame
+    DrawIndirectList        indirectList;
+
+    // The game thread fills one while the render thread draws the other
+    std::array<FrameSnapshot, 2> snapshots;
+    uint32_t                writeSnapshot{ 0U };
+    const FrameSnapshot*    drawnFrame{ nullptr };
+
+    // See RenderInitParams::useRenderThread
+    std::thread             renderThread;
+    std::function<void( bool current )> makeContextCurrent;
+    std::function<void()>   swapBuffers;
+    // Resource calls and frames, run by the render thread in order
+    std::deque<std::function<void()>> renderCommands;
+    std::mutex              renderMutex;
+    std::condition_variable renderCondition;
+    uint64_t                numCommandsQueued{ 0U };
+    uint64_t                numCommandsDone{ 0U };
+    // Ticket of the last frame handed to the render thread
+    uint64_t                lastFrameTicket{ 0U };
+    bool                    quitRenderThread{ false };
 
     static constexpr size_t EntityArraySize = sizeof( entities );
 };
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+
+// =====================================================================
+// ScopedTimer
+// 
+// Adds the time between its construction and destruction onto a
+// float, in milliseconds. Adding instead of overwriting lets a pass
+// be timed in several pieces
+// =====================================================================
+class ScopedTimer final
+{
+public:
+    ScopedTimer( float& milliseconds )
+        : target( milliseconds ), start( std::chrono::steady_clock::now() )
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        target += std::chrono::duration<float, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+    ScopedTimer( const ScopedTimer& ) = delete;
+    ScopedTimer& operator=( const ScopedTimer& ) = delete;
+
+private:
+    float&      target;
+    std::chrono::steady_clock::time_point start;
+};
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
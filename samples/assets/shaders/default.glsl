@@ -1,22 +1,46 @@
 #version 450 core
 #supports instancing
+#supports indirect
+#supports compactinstancing
 
 #section vertex
 
+#if SHADER_INDIRECT
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
 // Render data
 layout ( location = 0 ) in vec3 vertexPosition;
 layout ( location = 1 ) in vec3 vertexNormal;
 layout ( location = 2 ) in vec2 vertexCoord;
 
-#if SHADER_INSTANCED
+#if SHADER_COMPACT_INSTANCED
+// slots 3 to 6 are reserved for other things
+layout ( location = 7 ) in vec4 instancePositionScale;
+layout ( location = 8 ) in vec4 instanceOrientation;
+#elif SHADER_INSTANCED
 // slots 3 to 6 are reserved for other things
 layout ( location = 7 ) in mat4 instanceModelMatrix;
 #endif
 
+#include "viewdata.glsl"
+
+#if SHADER_INDIRECT
+// Per-draw data, one entry per instance of each indirect command
+struct DrawData
+{
+    mat4 modelMatrix;
+    uint materialIndex;
+};
+
+layout ( std430, binding = 0 ) readonly buffer DrawDataBuffer
+{
+    DrawData drawData[];
+};
+#endif
+
 // Uniforms
 uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
 
 // Outputs for the fragment shader
 out vec3 fragmentPosition;
@@ -24,10 +48,29 @@ out vec3 fragmentNormal;
 out vec2 fragmentCoord;
 out float fragmentVertexID;
 
+#if SHADER_COMPACT_INSTANCED
+// Rebuilds the model matrix out of a position, a uniform scale and a unit quaternion
+mat4 CompactModelMatrix( vec4 positionScale, vec4 q )
+{
+    const mat3 rotation = mat3(
+        1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y),
+        2.0 * (q.x * q.y - q.w * q.z), 1.0 - 2.0 * (q.x * q.x + q.z * q.z), 2.0 * (q.y * q.z + q.w * q.x),
+        2.0 * (q.x * q.z + q.w * q.y), 2.0 * (q.y * q.z - q.w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y) );
+
+    mat4 result = mat4( rotation * positionScale.w );
+    result[3] = vec4( positionScale.xyz, 1.0 );
+    return result;
+}
+#endif
+
 void main()
 {
-#if SHADER_INSTANCED
+#if SHADER_COMPACT_INSTANCED
+    const mat4 calcModelMatrix = CompactModelMatrix( instancePositionScale, instanceOrientation );
+#elif SHADER_INSTANCED
     const mat4 calcModelMatrix = instanceModelMatrix;
+#elif SHADER_INDIRECT
+    const mat4 calcModelMatrix = drawData[gl_BaseInstanceARB + gl_InstanceID].modelMatrix;
 #else
     const mat4 calcModelMatrix = modelMatrix;
 #endif
@@ -39,7 +82,7 @@ void main()
     fragmentCoord = vertexCoord;
     
     // Calculate vertex position
-    gl_Position = projMatrix * viewMatrix * calcModelMatrix * vec4( vertexPosition, 1.0 );
+    gl_Position = viewProjMatrix * calcModelMatrix * vec4( vertexPosition, 1.0 );
 
     fragmentVertexID = gl_VertexID;
 }
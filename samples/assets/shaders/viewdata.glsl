@@ -0,0 +1,8 @@
+// Per-view data, updated once per frame
+// Shared by every shader, matches ViewUniforms on the C++ side
+layout ( std140, binding = 0 ) uniform ViewData
+{
+    mat4 projMatrix;
+    mat4 viewMatrix;
+    mat4 viewProjMatrix;
+};
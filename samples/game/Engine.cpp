@@ -28,11 +28,20 @@ void Engine::Init( const char* title, int width, int height )
     // Set the OpenGL context version
     SDL_GL_SetAttribute( SDL_GL_CONTEXT_MAJOR_VERSION, 4 );
 	SDL_GL_SetAttribute( SDL_GL_CONTEXT_MINOR_VERSION, 5 );
+#ifndef NDEBUG
+    // Some drivers only bother with debug output in a debug context
+	SDL_GL_SetAttribute( SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG );
+#endif
     
     // Create the window and context
+	windowTitle = title;
 	window = SDL_CreateWindow( title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL );
 	SDL_GLContext glContext = SDL_GL_CreateContext( window );
 
+    // Turning on VSync here so my GPU (and yours) doesn't crash'n'burn
+    // Has to happen before the render thread takes the context away
+	SDL_GL_SetSwapInterval( 0 );
+
     // Initialise the render system with render init params
     renderSystem = foxglbox::GetRenderSystem();
     RenderInitParams rip {
@@ -41,13 +50,29 @@ void Engine::Init( const char* title, int width, int height )
         RenderInitParams::Windowing_SDL2,   // SDL2 windowing
         glContext                           // OpenGL 4.5 context
     };
+
+    // Edited shaders, textures and models show up without restarting
+    rip.hotReload = true;
+
+    // The render thread needs to be able to take the context and present frames
+    if ( useRenderThread )
+    {
+        rip.useRenderThread = true;
+        rip.makeContextCurrent = [this, glContext]( bool current )
+        {
+            SDL_GL_MakeCurrent( window, current ? glContext : nullptr );
+        };
+        rip.swapBuffers = [this]()
+        {
+            SDL_GL_SwapWindow( window );
+        };
+    }
+
     renderWorld = renderSystem->InitRenderer( rip );
 
     windowWidth = width;
     windowHeight = height;
 
-    // Turning on VSync here so my GPU (and yours) doesn't crash'n'burn
-	SDL_GL_SetSwapInterval( 0 );
     // Set relative mouse mode
     SDL_SetRelativeMouseMode( SDL_TRUE );
 
@@ -100,19 +125,46 @@ bool Engine::RunFrame()
         }
         // Render the frame!
         renderWorld->RenderFrame( mainView );
-        SDL_GL_SwapWindow( window );
+        // The render thread swaps on its own, once it's done drawing
+        if ( !useRenderThread )
+        {
+            SDL_GL_SwapWindow( window );
+        }
     }
     auto endPoint = chrono::system_clock::now();
     auto microSeconds = chrono::duration_cast<chrono::microseconds>(endPoint - startPoint);
 
     frameTime = (microSeconds.count() / (1000.0f * 1000.0f)) * timeScale;
-    float frameRate = 1.0f / frameTime;
 
-    printf( "## Frame time: %3.2f ms\n## Frame rate: %4.1f fps\n\n", (frameTime * 1000.0f), frameRate );
+    // Once a second is plenty for a window title
+    statsTimer += frameTime;
+    if ( statsTimer >= 1.0f )
+    {
+        statsTimer = 0.0f;
+        ShowFrameStats();
+    }
 
     return true;
 }
 
+void Engine::ShowFrameStats()
+{
+    const FrameStats stats = renderWorld->GetFrameStats();
+
+    // The GPU time of the last frame isn't known yet, so take the latest one that is
+    float gpuTime = -1.0f;
+    for ( uint32_t framesAgo = 0U; framesAgo < FrameStats::HistorySize && gpuTime < 0.0f; framesAgo++ )
+    {
+        gpuTime = renderWorld->GetFrameStats( framesAgo ).gpuTime;
+    }
+
+    char title[256];
+    snprintf( title, sizeof( title ), "%s | %3.2f ms (%4.1f fps) | CPU %3.2f ms | GPU %3.2f ms | %u draw calls | %u K triangles",
+              windowTitle.c_str(), frameTime * 1000.0f, 1.0f / frameTime, stats.GetCpuTime(), gpuTime,
+              stats.numDrawCalls, stats.numTriangles / 1000U );
+    SDL_SetWindowTitle( window, title );
+}
+
 void Engine::Shutdown()
 {
     for ( auto& ent : gameEntities )
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include "Vector.hpp"
 
 namespace Entities
@@ -32,6 +33,8 @@ public:
 
 private:
     void                CreateGameEntities();
+    // Puts the frame time and the renderer's frame stats into the window title
+    void                ShowFrameStats();
 
     template<typename EntityClass>
     EntityClass*        CreateEntity( fglVector position, fglVector angles, RenderModelHandle modelHandle );
@@ -49,6 +52,11 @@ private:
     float               timeScale{ 1.0f };
 
     SDL_Window*         window{ nullptr };
+    std::string         windowTitle;
+    // Seconds since the window title was last updated
+    float               statsTimer{ 0.0f };
+    // Draw on a separate thread, while the next frame is being simulated
+    bool                useRenderThread{ false };
     
     Entities::GameEntity* gameEntities[Entities::MaxGameEntities];
 };
@@ -6,6 +6,7 @@
 #include "Engine.hpp"
 
 #include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
 
 using namespace Entities;
 
@@ -31,6 +32,8 @@ void GameEntity::Present()
 void GameEntity::CalculateRenderParams()
 {
 	renderParams.renderMask = 0;
+	renderPosition = position;
+	renderRotation = rotation;
 
 	renderParams.position.x = position.x;
 	renderParams.position.y = position.y;
@@ -56,6 +59,7 @@ void Prop::Spawn()
 	entityFlags.canThink = false;
 	entityFlags.visible = true;
 
+	renderParams.isStatic = IsStatic();
 	CalculateRenderParams();
 	renderHandle = gEngine->GetRenderWorld()->CreateEntity( renderParams );
 
@@ -67,6 +71,12 @@ void Prop::Spawn()
 
 void Prop::Present()
 {
+	// Nothing to send to the renderer if the prop didn't move
+	if ( position == renderPosition && rotation == renderRotation )
+	{
+		return;
+	}
+
 	CalculateRenderParams();
 	gEngine->GetRenderWorld()->UpdateEntity( renderHandle, renderParams );
 }
@@ -80,9 +90,11 @@ void PropInstanced::Spawn()
 	fglVector originalPosition = position;
 	fglVector originalRotation = rotation;
 
-	// Populate render batch data
+	// Populate render batch data, the renderer keeps its own copy of it
+	// Compact params are half the size, and these props are only moved and rotated anyway
+	std::vector<RenderBatchCompactParam> batch( BatchSize );
 	float cycle = 0.0f;
-	for ( RenderBatchParam& param : batch )
+	for ( RenderBatchCompactParam& param : batch )
 	{
 		cycle += 0.1f;
 
@@ -98,15 +110,16 @@ void PropInstanced::Spawn()
 		// Update renderParams.position and renderParams.orientation
 		CalculateRenderParams();
 
-		param.modelMatrix = gEngine->GetRenderWorld()->CalculateModelMatrix( renderParams.position, renderParams.orientation );
+		const glm::quat orientation = glm::quat_cast( renderParams.orientation );
+		param.positionScale = glm::vec4( renderParams.position, 1.0f );
+		param.orientation = glm::vec4( orientation.x, orientation.y, orientation.z, orientation.w );
 	}
 
 	// Reset the entity's transform
 	position = originalPosition;
 	rotation = originalRotation;
 
-	renderParams.batch = batch;
-	renderParams.batchSize = BatchSize;
+	renderParams.batch = gEngine->GetRenderWorld()->CreateBatch( batch.data(), BatchSize );
 
 	// Call Prop::Spawn at the end, because we don't wanna set up render
 	// batch data AFTER the render entity was created - that'd be suboptimal
@@ -147,11 +160,14 @@ void Player::Spawn()
 
 void Player::Update( const float& deltaTime )
 {
+	const InputFlags lastInputFlags = inputFlags;
+
 	UpdateInput();
 	UpdateMovement( deltaTime );
 	UpdateCamera();
 
-	if ( inputFlags & InputReload )
+	// Only once per key press, holding R would recompile everything every frame
+	if ( (inputFlags & InputReload) && !(lastInputFlags & InputReload) )
 	{
 		gEngine->GetRenderWorld()->ReloadShaders();
 	}
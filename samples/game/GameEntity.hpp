@@ -40,6 +40,9 @@ namespace Entities
 
 		RenderEntityHandle renderHandle{ RenderHandleInvalid };
 		RenderEntityParams renderParams{};
+		// Transform that renderParams was last calculated from
+		fglVector		renderPosition{ fglVector::Zero };
+		fglVector		renderRotation{ fglVector::Zero };
 
 		struct EntityFlags
 		{
@@ -53,6 +56,9 @@ namespace Entities
 	public:
 		virtual void	Spawn() override;
 		void			Present() override;
+
+		// Static props are drawn without being copied every frame, but are slower to move
+		virtual bool	IsStatic() const { return true; }
 	};
 
 	class PropInstanced : public Prop
@@ -62,7 +68,6 @@ namespace Entities
 
 	private:
 		static constexpr uint32_t BatchSize = 65536; //1024;
-		RenderBatchParam batch[BatchSize];
 	};
 
 	class PropRotating : public Prop
@@ -70,6 +75,7 @@ namespace Entities
 	public:
 		void			Spawn() override;
 		void			Update( const float& deltaTime ) override;
+		bool			IsStatic() const override { return false; }
 	};
 
 	class Player final : public GameEntity
@@ -80,6 +80,16 @@ public: // Operators
         return *this;
     }
 
+    // == and !=
+    inline bool operator== ( const fglVector& rhs ) const
+    {
+        return x == rhs.x && y == rhs.y && z == rhs.z;
+    }
+    inline bool operator!= ( const fglVector& rhs ) const
+    {
+        return !(*this == rhs);
+    }
+
 public:
     float x, y, z;
 };
@@ -0,0 +1,244 @@
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "SDL.h"
+#include "SDL_opengl.h"
+#include "IRenderWorld.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+constexpr int Width = 1280;
+constexpr int Height = 720;
+
+// Game threads updating the render world at the same time
+constexpr int NumThreads = 8;
+// Persistent render entities, each thread owns an equal slice of them
+constexpr int NumEntities = 4096;
+// Immediate entities each thread submits per frame
+constexpr int ImmediatesPerThread = 256;
+// Frames to run before checking the results
+constexpr int NumFrames = 600;
+// Frames between render layer changes
+constexpr int LayerSwapFrames = 30;
+
+// The view sees layers 0 and 1
+constexpr int ViewMask = (1 << 0) | (1 << 1);
+// Every entity is on layer 0 at first. Then, every LayerSwapFrames, the
+// threads with an even index move theirs onto layers 0 and 1, where they
+// must still be drawn exactly once, and the odd ones onto layer 2,
+// where the view doesn't see them
+constexpr int VisibleMask = 1 << 0;
+constexpr int BothLayersMask = (1 << 0) | (1 << 1);
+constexpr int HiddenMask = 1 << 2;
+
+/*
+
+	Stress test for concurrent render entity updates
+	
+	Every frame, NumThreads threads update their slice of the render entities
+	and submit immediate entities, all at the same time. Every few frames, they
+	also move their entities to another render layer, so the renderworld has to
+	relink them at the start of the frame.
+
+	Every one of those calls has to succeed, and every frame has to draw each
+	visible entity and each immediate entity exactly once, going by its frame
+	stats. Otherwise this exits with 1.
+	Configure with FOX_USE_TSAN to check the renderworld for data races too.
+
+*/
+
+int main( int argc, char** argv )
+{
+	SDL_Init( SDL_INIT_VIDEO | SDL_INIT_EVENTS );
+	SDL_GL_SetAttribute( SDL_GL_CONTEXT_MAJOR_VERSION, 4 );
+	SDL_GL_SetAttribute( SDL_GL_CONTEXT_MINOR_VERSION, 5 );
+	SDL_Window* window = SDL_CreateWindow( "FoxGLBox stress test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, Width, Height, SDL_WINDOW_OPENGL );
+	SDL_GLContext glContext = SDL_GL_CreateContext( window );
+
+	RenderInitParams rip {
+		Width, Height,
+		RenderInitParams::Renderer_OpenGL45,
+		RenderInitParams::Windowing_SDL2,
+		glContext
+	};
+
+	// Looking down the grid from above
+	RenderView rv {
+		Width, Height,
+		ViewMask,
+		glm::vec3( 32.0f, 64.0f, 32.0f ),
+		glm::rotate( glm::identity<glm::mat4>(), glm::radians( -90.0f ), glm::vec3( 1.0f, 0.0f, 0.0f ) ),
+		90.0f,
+		false
+	};
+
+	IRenderWorld* renderWorld = foxglbox::GetRenderSystem()->InitRenderer( rip );
+	if ( nullptr == renderWorld )
+	{
+		std::cout << "Could not initialise the renderer" << std::endl;
+		return 1;
+	}
+
+	auto modelHandle = renderWorld->CreateModel( { "quad.obj", RenderModelType::FromFile } );
+	if ( modelHandle == RenderHandleInvalid )
+	{
+		std::cout << "Could not load quad.obj" << std::endl;
+		return 1;
+	}
+
+	std::vector<RenderEntityHandle> entityHandles;
+	for ( int i = 0; i < NumEntities; i++ )
+	{
+		RenderEntityParams params{ glm::vec3( i % 64, 0.0f, i / 64 ), glm::identity<glm::mat4>(), modelHandle, VisibleMask };
+		entityHandles.push_back( renderWorld->CreateEntity( params ) );
+		if ( entityHandles.back() == RenderHandleInvalid )
+		{
+			std::cout << "Could not create render entity " << i << std::endl;
+			return 1;
+		}
+	}
+
+	SDL_GL_SetSwapInterval( 0 );
+
+	std::atomic<int> numFailedUpdates{ 0 };
+	std::atomic<int> numFailedImmediates{ 0 };
+	int numBadFrames = 0;
+	int numCheckedFrames = 0;
+	int numFrames = 0;
+
+	// What each frame should have drawn, checked once its stats are in
+	std::vector<uint32_t> expectedEntities;
+	uint32_t trianglesPerEntity = 0U;
+	uint64_t nextFrameToCheck = 0U;
+
+	auto checkFrame = [&]( const FrameStats& stats )
+	{
+		const uint32_t expected = expectedEntities[stats.frameNumber];
+
+		// quad.obj has one surface, the triangle count is taken from the first frame
+		if ( !trianglesPerEntity && stats.numSurfaces )
+		{
+			trianglesPerEntity = stats.numTriangles / stats.numSurfaces;
+		}
+
+		if ( stats.numEntities != expected || stats.numSurfaces != expected
+			 || !trianglesPerEntity || stats.numTriangles != expected * trianglesPerEntity )
+		{
+			std::cout << "Frame " << stats.frameNumber << ": expected " << expected << " entities, got "
+				<< stats.numEntities << " entities, " << stats.numSurfaces << " surfaces and "
+				<< stats.numTriangles << " triangles" << std::endl;
+			numBadFrames++;
+		}
+
+		numCheckedFrames++;
+	};
+	bool quit = false;
+	SDL_Event e;
+
+	while ( !quit && numFrames < NumFrames )
+	{
+		while ( SDL_PollEvent( &e ) )
+		{
+			if ( e.type == SDL_QUIT )
+				quit = true;
+		}
+
+		const bool layersSwapped = (numFrames / LayerSwapFrames) % 2;
+		const float time = numFrames * 0.016f;
+
+		std::vector<std::thread> threads;
+		for ( int t = 0; t < NumThreads; t++ )
+		{
+			threads.emplace_back( [&, t]()
+			{
+				const int first = t * NumEntities / NumThreads;
+				const int last = (t + 1) * NumEntities / NumThreads;
+				const int renderMask = !layersSwapped ? VisibleMask : (t % 2 ? HiddenMask : BothLayersMask);
+				for ( int i = first; i < last; i++ )
+				{
+					const float height = sin( time + i * 0.1f );
+					RenderEntityParams params{ glm::vec3( i % 64, height, i / 64 ), glm::identity<glm::mat4>(), modelHandle, renderMask };
+					if ( !renderWorld->UpdateEntity( entityHandles[i], params ) )
+					{
+						numFailedUpdates++;
+					}
+				}
+
+				for ( int i = 0; i < ImmediatesPerThread; i++ )
+				{
+					RenderEntityParams params{ glm::vec3( t * 8 + i % 8, 2.0f, i / 8 ), glm::identity<glm::mat4>(), modelHandle, 0 };
+					if ( !renderWorld->CreateImmediateEntity( params ) )
+					{
+						numFailedImmediates++;
+					}
+				}
+			} );
+		}
+
+		// The threads are done before the frame is rendered
+		for ( auto& thread : threads )
+		{
+			thread.join();
+		}
+
+		// Immediate entities have no render mask, so they're always drawn
+		uint32_t expected = NumThreads * ImmediatesPerThread;
+		for ( int t = 0; t < NumThreads; t++ )
+		{
+			if ( !layersSwapped || t % 2 == 0 )
+			{
+				expected += (t + 1) * NumEntities / NumThreads - t * NumEntities / NumThreads;
+			}
+		}
+		expectedEntities.push_back( expected );
+
+		renderWorld->RenderFrame( rv );
+		SDL_GL_SwapWindow( window );
+		numFrames++;
+
+		// With a render thread, the latest drawn frame may be behind by one
+		const FrameStats stats = renderWorld->GetFrameStats();
+		while ( nextFrameToCheck <= stats.frameNumber && stats.numEntities )
+		{
+			checkFrame( renderWorld->GetFrameStats( stats.frameNumber - nextFrameToCheck ) );
+			nextFrameToCheck++;
+		}
+	}
+
+	// The render thread is done with everything once it's shut down
+	renderWorld->Shutdown();
+	const FrameStats lastStats = renderWorld->GetFrameStats();
+	while ( nextFrameToCheck <= lastStats.frameNumber && nextFrameToCheck < expectedEntities.size() )
+	{
+		checkFrame( renderWorld->GetFrameStats( lastStats.frameNumber - nextFrameToCheck ) );
+		nextFrameToCheck++;
+	}
+	SDL_Quit();
+
+	std::cout << "Ran " << numFrames << " frames with " << NumThreads << " threads" << std::endl;
+	std::cout << "Failed entity updates: " << numFailedUpdates << std::endl;
+	std::cout << "Failed immediate entities: " << numFailedImmediates << std::endl;
+	std::cout << "Frames with wrong draws: " << numBadFrames << " of " << numCheckedFrames << " checked" << std::endl;
+	return (numFailedUpdates || numFailedImmediates || numBadFrames || numCheckedFrames != numFrames) ? 1 : 0;
+}
+
+
+/*
+Copyright (c) 2021 Admer456
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/